@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds ecumene-bench from the library and benchmark sources:
+#
+#     bench/build.sh [output]
+#
+# Needs czmq, libzmq, lz4 and the msgpack-c headers. CXX and CXXFLAGS are
+# honoured; the default is an optimized build, which is what the numbers
+# should come from.
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+out=${1:-ecumene-bench}
+
+${CXX:-c++} -std=c++14 ${CXXFLAGS:--O2 -DNDEBUG} -I"$root/include" \
+    "$root"/src/*.cpp "$root"/bench/*.cpp \
+    -o "$out" -lczmq -lzmq -llz4 -pthread
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <czmq.h>
+#include <msgpack.hpp>
+
+#include "ecumene/ecm_key.h"
+#include "ecumene/function_call.h"
+#include "ecumene/function_call_result.h"
+
+#include "harness.h"
+
+using namespace ecumene;
+
+namespace {
+
+const msgpack::sbuffer &packedArgs()
+{
+    static const msgpack::sbuffer sbuf = []() {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, std::make_tuple(42, std::string(48, 'x')));
+        return sbuf;
+    }();
+    return sbuf;
+}
+
+}
+
+BENCHMARK("function_call/construct", iterations)
+{
+    const detail::EcmKey key = detail::internEcmKey("bench.call");
+    const msgpack::sbuffer &sbuf = packedArgs();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        FunctionCall call(
+                key,
+                sbuf,
+                [](const FunctionCallResult &&result) { bench::keep(result.size()); },
+                std::chrono::seconds(15));
+        bench::keep(call);
+    }
+}
+
+// Moves one call back and forth between two slots
+BENCHMARK("function_call/move", iterations)
+{
+    alignas(FunctionCall) unsigned char slots[2][sizeof (FunctionCall)];
+
+    FunctionCall *from = new (slots[0]) FunctionCall(
+            detail::internEcmKey("bench.call"),
+            packedArgs(),
+            [](const FunctionCallResult &&result) { bench::keep(result.size()); },
+            std::chrono::seconds(15));
+    for (std::size_t i = 0; i < iterations; ++i) {
+        FunctionCall *to = new (slots[(i + 1) & 1]) FunctionCall(std::move(*from));
+        from->~FunctionCall();
+        from = to;
+    }
+    from->~FunctionCall();
+}
+
+BENCHMARK("function_call_result/construct", iterations)
+{
+    static const char RESULT[] = "\xa5hello";
+    for (std::size_t i = 0; i < iterations; ++i) {
+        zframe_t *status = zframe_new_empty();
+        zframe_t *data = zframe_new(RESULT, sizeof RESULT - 1);
+        FunctionCallResult result(&status, &data);
+        bench::keep(result.size());
+    }
+}
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <msgpack.hpp>
+
+#include "ecumene/call_table.h"
+#include "ecumene/ecm_key.h"
+#include "ecumene/function_call.h"
+
+#include "harness.h"
+
+using namespace ecumene;
+
+namespace {
+
+FunctionCall makeCall(const std::chrono::seconds &timeout)
+{
+    static const msgpack::sbuffer sbuf = []() {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, std::make_tuple(42));
+        return sbuf;
+    }();
+
+    return FunctionCall(
+            detail::internEcmKey("bench.table"),
+            sbuf,
+            [](const FunctionCallResult &&) {},
+            timeout);
+}
+
+// A table with `inFlight` calls that won't time out during the run
+void fill(detail::CallTable &table, std::size_t inFlight)
+{
+    for (std::size_t i = 0; i < inFlight; ++i) {
+        table.insert(makeCall(std::chrono::seconds(3600)));
+    }
+}
+
+const bool registered = []() {
+    for (const std::size_t inFlight: { 0, 64, 1024, 16384, 262144 }) {
+        const std::string suffix = "/inflight:" + std::to_string(inFlight);
+
+        // Calls are made outside the loop, so only the table is measured
+        bench::add("call_table/insert_find_erase" + suffix, [inFlight](std::size_t iterations) {
+            detail::CallTable table;
+            fill(table, inFlight);
+
+            std::vector<FunctionCall> calls;
+            calls.reserve(64);
+            for (std::size_t i = 0; i < iterations; i += calls.size()) {
+                calls.clear();
+                for (std::size_t j = 0; j < 64 && i + j < iterations; ++j) {
+                    calls.push_back(makeCall(std::chrono::seconds(15)));
+                }
+                for (auto &call: calls) {
+                    const auto id = table.insert(std::move(call));
+                    bench::keep(table.find(id));
+                    table.erase(id);
+                }
+            }
+        });
+
+        // Each op inserts a call whose deadline has already passed, at a
+        // different point in the past, and sweeps it out among the live ones
+        bench::add("call_table/sweep" + suffix, [inFlight](std::size_t iterations) {
+            detail::CallTable table;
+            fill(table, inFlight);
+
+            std::vector<FunctionCall> calls;
+            calls.reserve(64);
+            for (std::size_t i = 0; i < iterations; i += calls.size()) {
+                calls.clear();
+                for (std::size_t j = 0; j < 64 && i + j < iterations; ++j) {
+                    calls.push_back(makeCall(-std::chrono::seconds(1 + j % 8)));
+                }
+                for (auto &call: calls) {
+                    table.insert(std::move(call));
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                detail::CallTable::Id expired;
+                while ((expired = table.nextExpired(now)) != 0) {
+                    table.erase(expired);
+                }
+            }
+        });
+    }
+    return true;
+}();
+
+}
@@ -0,0 +1,256 @@
+// Microbenchmarks for the library's hot paths, reporting time and heap
+// allocations per operation, C allocations included where the C library
+// allows it:
+//
+//     ecumene-bench [--filter <substring>] [--min-time <seconds>]
+//                   [--save <file>] [--baseline <file>]
+//
+// `--save` writes the results to a file that a later run compares against
+// with `--baseline`, to show what changed between two builds. build.sh next
+// to this file builds it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+namespace {
+
+std::atomic<std::size_t> allocations{0};
+
+struct Benchmark {
+    std::string name;
+    bench::Body body;
+};
+
+std::vector<Benchmark> &registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Result {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+struct Options {
+    std::string filter;
+    double minTime = 0.5;
+    std::string save;
+    std::string baseline;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+            "usage: ecumene-bench [--filter <substring>] [--min-time <seconds>] "
+            "[--save <file>] [--baseline <file>]\n");
+    std::exit(2);
+}
+
+Options parse(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            usage();
+        }
+        if (std::strcmp(argv[i], "--filter") == 0) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0) {
+            options.minTime = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--save") == 0) {
+            options.save = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0) {
+            options.baseline = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    return options;
+}
+
+// Grows the iteration count until a run takes at least `minTime`
+Result run(const bench::Body &body, double minTime)
+{
+    std::size_t iterations = 1;
+    while (true) {
+        const std::size_t allocsBefore = allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        body(iterations);
+        const double elapsed = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        const std::size_t allocs = allocations.load() - allocsBefore;
+
+        if (elapsed >= minTime || iterations >= (std::size_t(1) << 40)) {
+            return Result {
+                elapsed * 1e9 / iterations,
+                static_cast<double>(allocs) / iterations };
+        }
+
+        // Aim a little past the target so the next run is the last
+        const double factor = elapsed > 0 ? 1.2 * minTime / elapsed : 100;
+        iterations = static_cast<std::size_t>(
+                iterations * std::min(std::max(factor, 2.0), 100.0));
+    }
+}
+
+std::map<std::string, Result> load(const std::string &path)
+{
+    std::map<std::string, Result> results;
+    std::ifstream in(path);
+    std::string name;
+    Result result;
+    while (in >> name >> result.nsPerOp >> result.allocsPerOp) {
+        results[name] = result;
+    }
+    return results;
+}
+
+}
+
+#if defined(__GLIBC__)
+
+// Every heap allocation in the process is counted, including those of czmq
+// and libzmq, by interposing malloc itself. operator new goes through it.
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *p);
+
+void *malloc(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+
+}
+
+static const char *ALLOCS_LABEL = "allocs/op";
+
+#else
+
+// Without a way to interpose malloc, only C++ allocations are counted
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static const char *ALLOCS_LABEL = "new/op";
+
+#endif
+
+namespace bench {
+
+bool add(const std::string &name, Body &&body)
+{
+    registry().push_back(Benchmark { name, std::move(body) });
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const Options options = parse(argc, argv);
+    const auto baseline = options.baseline.empty()
+        ? std::map<std::string, Result>()
+        : load(options.baseline);
+
+    std::ofstream save;
+    if (!options.save.empty()) {
+        save.open(options.save);
+    }
+
+    auto &benchmarks = registry();
+    std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const Benchmark &a, const Benchmark &b) { return a.name < b.name; });
+
+    std::printf("%-40s %12s %10s", "benchmark", "ns/op", ALLOCS_LABEL);
+    if (!baseline.empty()) {
+        std::printf(" %12s %10s", "baseline", "change");
+    }
+    std::printf("\n");
+
+    for (const auto &benchmark: benchmarks) {
+        if (benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        const Result result = run(benchmark.body, options.minTime);
+        std::printf("%-40s %12.1f %10.2f",
+                benchmark.name.c_str(), result.nsPerOp, result.allocsPerOp);
+
+        const auto before = baseline.find(benchmark.name);
+        if (before != baseline.end()) {
+            std::printf(" %12.1f %+9.1f%%",
+                    before->second.nsPerOp,
+                    100 * (result.nsPerOp / before->second.nsPerOp - 1));
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+
+        if (save.is_open()) {
+            save << benchmark.name << ' ' << result.nsPerOp << ' '
+                << result.allocsPerOp << '\n';
+        }
+    }
+
+    return 0;
+}
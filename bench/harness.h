@@ -0,0 +1,39 @@
+#ifndef ECUMENE_BENCH_HARNESS_H
+#define ECUMENE_BENCH_HARNESS_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace bench {
+
+// Runs the measured loop `iterations` times. Setup done before the loop is
+// timed too, so keep it cheap or amortize it over the iterations.
+using Body = std::function<void(std::size_t iterations)>;
+
+// Registers a benchmark; call from a static initializer
+bool add(const std::string &name, Body &&body);
+
+// Keeps the compiler from optimizing away a value
+template<class T>
+inline void keep(T &&value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+}
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+
+// Registers the function defined right after it:
+//
+//     BENCHMARK("group/name", iterations) { for (...) ...; }
+#define BENCHMARK(name, iterations) \
+    static void BENCH_CONCAT(bench_, __LINE__)(std::size_t); \
+    static const bool BENCH_CONCAT(benchRegistered_, __LINE__) = \
+        bench::add(name, BENCH_CONCAT(bench_, __LINE__)); \
+    static void BENCH_CONCAT(bench_, __LINE__)(std::size_t iterations)
+
+#endif /* ECUMENE_BENCH_HARNESS_H */
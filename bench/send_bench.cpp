@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <czmq.h>
+#include <msgpack.hpp>
+
+#include "ecumene/client_agent.h"
+#include "ecumene/ecm_key.h"
+#include "ecumene/function_call.h"
+
+#include "harness.h"
+
+using namespace ecumene;
+
+namespace {
+
+const char *REGISTRY_ENDPOINT = "inproc://ecumene-bench-registry";
+const char *WORKER_ENDPOINT = "inproc://ecumene-bench-worker";
+
+// Stands in for Ecumene and the worker: every key resolves to a worker that
+// takes requests and never answers
+void standIn(zsock_t *pipe, void *)
+{
+    zsock_t *registry = zsock_new_router(REGISTRY_ENDPOINT);
+    zsock_t *worker = zsock_new_router(WORKER_ENDPOINT);
+    zpoller_t *poller = zpoller_new(pipe, registry, worker, nullptr);
+    zsock_signal(pipe, 0);
+
+    while (!zsys_interrupted) {
+        zsock_t *sock = static_cast<zsock_t *>(zpoller_wait(poller, -1));
+        if (!sock || sock == pipe) {
+            break;
+        }
+
+        zmsg_t *msg = zmsg_recv(sock);
+        if (msg && sock == registry) {
+            // [identity, version, id, ecmKey(, "*")] gets
+            // [identity, id, ecmKey, "", endpoint]
+            zframe_t *identity = zmsg_pop(msg);
+            zframe_t *version = zmsg_pop(msg);
+            zframe_destroy(&version);
+            char *id = zmsg_popstr(msg);
+            char *ecmKey = zmsg_popstr(msg);
+
+            zmsg_t *assignment = zmsg_new();
+            zmsg_append(assignment, &identity);
+            zmsg_addstr(assignment, id);
+            zmsg_addstr(assignment, ecmKey);
+            zmsg_addstr(assignment, "");
+            zmsg_addstr(assignment, WORKER_ENDPOINT);
+            zmsg_send(&assignment, registry);
+
+            zstr_free(&id);
+            zstr_free(&ecmKey);
+        }
+        zmsg_destroy(&msg);
+    }
+
+    zpoller_destroy(&poller);
+    zsock_destroy(&worker);
+    zsock_destroy(&registry);
+}
+
+// Stopped before czmq shuts down, since it was started after czmq was
+struct StandIn {
+    zactor_t *actor = zactor_new(standIn, nullptr);
+
+    ~StandIn()
+    {
+        zactor_destroy(&actor);
+    }
+};
+
+// Calls go to the stand-in worker and time out quickly, so this measures
+// handing calls to the network thread and writing them out, and nothing
+// outside the process
+const bool registered = []() {
+    // Before the client agent first starts
+    setenv("ECUMENE_REGISTRY", REGISTRY_ENDPOINT, 1);
+
+    for (const std::size_t threads: { 1, 2, 4, 8, 16, 32, 64 }) {
+        bench::add(
+                "client_agent/send/threads:" + std::to_string(threads),
+                [threads](std::size_t iterations) {
+            static StandIn stub;
+            (void)stub;
+
+            static const msgpack::sbuffer sbuf = []() {
+                msgpack::sbuffer sbuf;
+                msgpack::pack(sbuf, std::make_tuple(42));
+                return sbuf;
+            }();
+
+            const detail::EcmKey key = detail::internEcmKey("bench.stub");
+            ClientAgent &agent = ClientAgent::sharedInstance();
+
+            std::vector<std::thread> pool;
+            for (std::size_t t = 0; t < threads; ++t) {
+                const std::size_t share = iterations / threads + (t < iterations % threads);
+                pool.emplace_back([&agent, key, share]() {
+                    for (std::size_t i = 0; i < share; ++i) {
+                        agent.send(FunctionCall(
+                                    key,
+                                    sbuf,
+                                    [](const FunctionCallResult &&) {},
+                                    std::chrono::seconds(1)));
+                    }
+                });
+            }
+            for (auto &thread: pool) {
+                thread.join();
+            }
+        });
+    }
+    return true;
+}();
+
+}
@@ -0,0 +1,101 @@
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <msgpack.hpp>
+
+#include "ecumene/decoder.h"
+#include "ecumene/function_impl.h"
+#include "ecumene/pool.h"
+#include "ecumene/ref.h"
+
+#include "harness.h"
+
+using namespace ecumene;
+
+namespace {
+
+using Args = std::tuple<int, std::string, std::vector<double>>;
+
+const Args &typicalArgs()
+{
+    static const Args args(42, std::string(48, 'x'), std::vector<double>(16, 1.5));
+    return args;
+}
+
+const msgpack::sbuffer &packedArgs()
+{
+    static const msgpack::sbuffer sbuf = []() {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, typicalArgs());
+        return sbuf;
+    }();
+    return sbuf;
+}
+
+}
+
+BENCHMARK("msgpack/pack", iterations)
+{
+    const Args &args = typicalArgs();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        detail::Pooled<msgpack::sbuffer> sbuf;
+        msgpack::pack(*sbuf, args);
+        bench::keep(sbuf->size());
+    }
+}
+
+BENCHMARK("msgpack/unpack_as", iterations)
+{
+    const msgpack::sbuffer &sbuf = packedArgs();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        detail::Pooled<msgpack::zone> zone;
+        Args args = msgpack::unpack(*zone, sbuf.data(), sbuf.size()).as<Args>();
+        bench::keep(args);
+    }
+}
+
+BENCHMARK("msgpack/decode", iterations)
+{
+    const msgpack::sbuffer &sbuf = packedArgs();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        detail::Pooled<msgpack::zone> zone;
+        Args args = detail::decode<Args>(sbuf.data(), sbuf.size(), *zone);
+        bench::keep(args);
+    }
+}
+
+BENCHMARK("msgpack/decode_ref", iterations)
+{
+    using RefArgs = std::tuple<int, StringRef, std::vector<double>>;
+
+    const msgpack::sbuffer &sbuf = packedArgs();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        detail::Pooled<msgpack::zone> zone;
+        RefArgs args = detail::decode<RefArgs>(sbuf.data(), sbuf.size(), *zone);
+        bench::keep(args);
+    }
+}
+
+BENCHMARK("function_impl/decode_args", iterations)
+{
+    const msgpack::sbuffer &sbuf = packedArgs();
+    const detail::MessageHeader header;
+    for (std::size_t i = 0; i < iterations; ++i) {
+        detail::DecodeScope scope;
+        Args args = detail::decodeArgs<int, int, std::string, std::vector<double>>(
+                sbuf.data(), sbuf.size(), header, scope);
+        bench::keep(args);
+    }
+}
+
+BENCHMARK("function_impl/apply_tuple", iterations)
+{
+    const Args &args = typicalArgs();
+    const auto func = [](int n, const std::string &s, const std::vector<double> &v) {
+        return n + s.size() + v.size();
+    };
+    for (std::size_t i = 0; i < iterations; ++i) {
+        bench::keep(detail::applyTuple(func, args));
+    }
+}
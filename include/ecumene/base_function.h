@@ -2,9 +2,17 @@
 #define ECUMENE_BASE_FUNCTION_H
 
 #include <chrono>
+#include <cstddef>
+#include <exception>
 #include <string>
+#include <vector>
 
+#include "ecumene/blob.h"
+#include "ecumene/compression.h"
+#include "ecumene/ecm_key.h"
 #include "ecumene/function_call_result.h"
+#include "ecumene/partition.h"
+#include "ecumene/priority.h"
 
 namespace ecumene {
 
@@ -15,10 +23,47 @@ public:
     void operator =(const BaseFunction &rhs);
 
     void setTimeout(const std::chrono::seconds &timeout);
+    void setCompressionThreshold(std::size_t threshold);
+
+    // Idempotent calls are sent to another worker if theirs goes away
+    // before answering; others fail right away with NetworkError.
+    void setIdempotent(bool idempotent);
+
+    // Arguments at least this many bytes long once packed are sent as a
+    // digest, and only in full to workers that haven't seen them recently.
+    // Workers must understand this; off by default.
+    void setBlobThreshold(std::size_t threshold);
+
+    // Chunks of an Upload argument that may be on their way to the worker
+    // before it acknowledges any; DefaultUploadWindow by default
+    void setUploadWindow(std::size_t chunks);
+
+    // Calls of higher priority are dispatched and served first; Normal by
+    // default. Use a copy of the function for calls of another class.
+    void setPriority(Priority priority);
+
+    // Blocking calls spin this long for the result before going to sleep,
+    // which pays off when replies take only tens of microseconds. Off by
+    // default.
+    void setSpin(const std::chrono::microseconds &spin);
+
+    // Resolves and connects a worker ahead of the first call
+    void prefetch() const;
 
 protected:
     std::string _ecmKey;
+    detail::EcmKey _keyId;
     std::chrono::seconds _timeout;
+    std::size_t _compressionThreshold;
+    bool _idempotent;
+    std::size_t _blobThreshold;
+    std::chrono::microseconds _spin;
+    Priority _priority;
+    std::size_t _uploadWindow;
+    std::size_t _partitionKey;
+
+    // Keys the result is handed to next, worker to worker
+    std::vector<std::string> _chain;
 
     std::exception_ptr handleError(const FunctionCallResult &result) const;
 };
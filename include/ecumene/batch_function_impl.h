@@ -0,0 +1,177 @@
+#ifndef ECUMENE_BATCH_FUNCTION_IMPL_H
+#define ECUMENE_BATCH_FUNCTION_IMPL_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "ecumene/function_impl.h"
+
+namespace ecumene {
+
+template<class T>
+class BatchFunctionImpl;
+
+// Serves the same calls as FunctionImpl<R(Args...)>, but hands requests to
+// the handler in batches of up to `maxBatchSize`, waiting at most `maxWait`
+// after the first one arrives. Callers are unaffected.
+template<class R, class ... Args>
+class BatchFunctionImpl<R(Args...)> {
+    static_assert(!std::is_void<R>::value, "batch handlers must return results");
+    static_assert(!detail::HoldsRefs<std::tuple<Args...>>::value,
+            "batched arguments outlive their request, so they can't be references");
+    static_assert(!detail::AnyOf<detail::IsChunkStream, Args...>::value,
+            "batch handlers can't read streams");
+
+public:
+    using Batch = std::vector<std::tuple<Args...>>;
+
+    explicit BatchFunctionImpl(
+            const std::string &ecmKey,
+            const std::string &localEndpoint,
+            const std::string &publicEndpoint,
+            const std::function<std::vector<R>(const Batch &)> &func,
+            std::size_t maxBatchSize,
+            const std::chrono::milliseconds &maxWait)
+        : _ecmKey(ecmKey)
+        , _publicEndpoint(publicEndpoint)
+        , _func(func)
+        , _maxBatchSize(maxBatchSize > 0 ? maxBatchSize : 1)
+        , _maxWait(maxWait)
+        , _agent(
+                ecmKey,
+                localEndpoint,
+                publicEndpoint,
+                [this](
+                        const char *data,
+                        std::size_t size,
+                        const detail::MessageHeader &requestHeader,
+                        const WorkerReply &reply) {
+                    if (_batch.empty()) {
+                        _flushAt = std::chrono::steady_clock::now() + _maxWait;
+                    }
+
+                    detail::DecodeScope scope;
+                    _batch.push_back(detail::decodeArgs<R, Args...>(
+                                data, size, requestHeader, scope));
+                    _callers.push_back(Caller {
+                            reply,
+                            requestHeader.has(detail::MessageHeader::Raw) });
+
+                    if (_batch.size() >= _maxBatchSize) {
+                        flush();
+                    }
+                },
+                [this]() {
+                    if (_batch.empty()) {
+                        return std::chrono::milliseconds(-1);
+                    }
+
+                    const auto now = std::chrono::steady_clock::now();
+                    if (now >= _flushAt) {
+                        flush();
+                        return std::chrono::milliseconds(-1);
+                    }
+
+                    // Round up so we don't wake just before the deadline
+                    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                            _flushAt - now) + std::chrono::milliseconds(1);
+                })
+    {
+        HeartbeatService::sharedInstance().registerWorker(
+                _ecmKey, _publicEndpoint);
+    }
+
+    BatchFunctionImpl(const BatchFunctionImpl &) = delete;
+    BatchFunctionImpl(BatchFunctionImpl &&) = delete;
+    void operator =(const BatchFunctionImpl &) = delete;
+
+    ~BatchFunctionImpl()
+    {
+        unregister();
+    }
+
+    std::vector<R> operator ()(const Batch &batch)
+    {
+        return _func(batch);
+    }
+
+    void setCompressionThreshold(std::size_t threshold)
+    {
+        _agent.setCompressionThreshold(threshold);
+    }
+
+    // Off by default, since registries that predate load reports may not
+    // accept the extra heartbeat frame
+    void setLoadReporting(bool enabled)
+    {
+        HeartbeatService::sharedInstance().setWorkerLoad(
+                _ecmKey, _publicEndpoint, enabled ? _agent.load() : nullptr);
+    }
+
+    void unregister()
+    {
+        HeartbeatService::sharedInstance().unregisterWorker(
+                _ecmKey, _publicEndpoint);
+    }
+
+private:
+    using Completion = detail::Completion<R, Args...>;
+
+    struct Caller {
+        WorkerReply reply;
+        bool raw;
+    };
+
+    const std::string _ecmKey;
+    const std::string _publicEndpoint;
+    const std::function<std::vector<R>(const Batch &)> _func;
+    const std::size_t _maxBatchSize;
+    const std::chrono::milliseconds _maxWait;
+
+    // Only touched on the worker thread
+    Batch _batch;
+    std::vector<Caller> _callers;
+    std::chrono::steady_clock::time_point _flushAt;
+
+    WorkerAgent _agent;
+
+    // Runs the handler once and scatters the results to their callers
+    void flush()
+    {
+        Batch batch;
+        std::vector<Caller> callers;
+        batch.swap(_batch);
+        callers.swap(_callers);
+
+        try {
+            const std::vector<R> results = _func(batch);
+            if (results.size() != callers.size()) {
+                throw UnknownError("batch handler returned wrong number of results");
+            }
+
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                Completion::complete(results[i], callers[i].raw, callers[i].reply);
+            }
+        } catch (...) {
+            const auto eptr = std::current_exception();
+            for (const auto &caller: callers) {
+                caller.reply.fail(eptr);
+            }
+        }
+
+        // Keep the capacity for the next batch
+        batch.clear();
+        callers.clear();
+        _batch.swap(batch);
+        _callers.swap(callers);
+    }
+};
+
+}
+
+#endif /* ECUMENE_BATCH_FUNCTION_IMPL_H */
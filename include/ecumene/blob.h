@@ -0,0 +1,270 @@
+#ifndef ECUMENE_BLOB_H
+#define ECUMENE_BLOB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <msgpack.hpp>
+
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+constexpr std::size_t NoBlobs = std::numeric_limits<std::size_t>::max();
+
+// Bytes of recently seen large arguments a worker process keeps, 256 MiB by
+// default
+void setBlobCacheCapacity(std::size_t bytes);
+
+namespace detail {
+
+// Large arguments travel as MessagePack extensions in place of the packed
+// argument: either its SHA-1 digest, or the packed argument itself
+static const std::int8_t BLOB_REF = 'b';
+static const std::int8_t BLOB_DATA = 'B';
+static const std::size_t BLOB_DIGEST_SIZE = 20;
+
+// A request referred to blobs the worker does not have
+class BlobMissing: public std::runtime_error {
+public:
+    BlobMissing()
+        : std::runtime_error("blob missing")
+    {
+    }
+};
+
+std::string digestOf(const char *data, std::size_t size);
+
+// A large argument sent by reference: where its reference sits in the
+// packed arguments, and the packed argument itself
+struct BlobArgument {
+    std::size_t offset;
+    std::size_t length;
+    std::shared_ptr<const msgpack::sbuffer> packed;
+};
+
+using BlobArguments = std::vector<BlobArgument>;
+
+// Appends a reference to `refs` in place of the packed argument
+void packReference(
+        msgpack::sbuffer &refs,
+        BlobArguments &blobs,
+        const std::string &digest,
+        const std::shared_ptr<const msgpack::sbuffer> &packed);
+
+// Appends the arguments packed by reference to `full` with the referenced
+// ones put back: as extensions the worker caches, or else as they were
+// packed
+void inlineBlobs(
+        const char *refs,
+        std::size_t size,
+        const BlobArguments &blobs,
+        bool asExtensions,
+        msgpack::sbuffer &full);
+
+}
+
+// An argument packed and hashed once, however many calls it is passed to,
+// rather than once per call. Copies share the value. Workers take it as a
+// plain T.
+template<class T>
+class Shared {
+public:
+    explicit Shared(T value)
+        : _state(std::make_shared<State>(std::move(value)))
+    {
+    }
+
+    const T &operator *() const
+    {
+        return _state->value;
+    }
+
+    const T *operator ->() const
+    {
+        return &_state->value;
+    }
+
+    // Used when sending
+    std::shared_ptr<const msgpack::sbuffer> packed() const
+    {
+        std::call_once(_state->packOnce, [this]() {
+            msgpack::pack(_state->packed, _state->value);
+        });
+        return std::shared_ptr<const msgpack::sbuffer>(_state, &_state->packed);
+    }
+
+    const std::string &digest() const
+    {
+        std::call_once(_state->digestOnce, [this]() {
+            const auto bytes = packed();
+            _state->digest = detail::digestOf(bytes->data(), bytes->size());
+        });
+        return _state->digest;
+    }
+
+private:
+    struct State {
+        explicit State(T &&value)
+            : value(std::move(value))
+        {
+        }
+
+        const T value;
+        std::once_flag packOnce;
+        msgpack::sbuffer packed;
+        std::once_flag digestOnce;
+        std::string digest;
+    };
+
+    std::shared_ptr<State> _state;
+};
+
+namespace detail {
+
+// Appends one argument to `refs`, by reference if it is at least `threshold`
+// bytes long once packed. `scratch` is reused between arguments.
+template<class T>
+void packArgument(
+        msgpack::sbuffer &refs,
+        BlobArguments &blobs,
+        Pooled<msgpack::sbuffer> &scratch,
+        std::size_t threshold,
+        const T &arg)
+{
+    scratch->clear();
+    msgpack::pack(*scratch, arg);
+    if (scratch->size() < threshold) {
+        refs.write(scratch->data(), scratch->size());
+        return;
+    }
+
+    // Kept without a copy in case the worker asks for it
+    const std::string digest = digestOf(scratch->data(), scratch->size());
+    packReference(
+            refs,
+            blobs,
+            digest,
+            std::make_shared<msgpack::sbuffer>(std::move(*scratch)));
+}
+
+template<class T>
+void packArgument(
+        msgpack::sbuffer &refs,
+        BlobArguments &blobs,
+        Pooled<msgpack::sbuffer> &,
+        std::size_t threshold,
+        const Shared<T> &arg)
+{
+    const auto packed = arg.packed();
+    if (packed->size() < threshold) {
+        refs.write(packed->data(), packed->size());
+        return;
+    }
+
+    packReference(refs, blobs, arg.digest(), packed);
+}
+
+// Packs the arguments as an array into `refs`, with large ones by reference
+// and kept in `blobs`. Returns false if there were none, in which case
+// `refs` is what msgpack::pack would have made of the tuple.
+template<class ... Args>
+bool packBlobs(
+        msgpack::sbuffer &refs,
+        BlobArguments &blobs,
+        std::size_t threshold,
+        const Args &... args)
+{
+    msgpack::packer<msgpack::sbuffer>(refs).pack_array(sizeof...(Args));
+
+    Pooled<msgpack::sbuffer> scratch;
+    const int unused[] = { 0, (
+            packArgument(refs, blobs, scratch, threshold, args),
+            0)... };
+    (void)unused;
+
+    return !blobs.empty();
+}
+
+// An argument unpacked once and shared by every request that refers to it
+struct Blob {
+    std::unique_ptr<msgpack::zone> zone;
+    msgpack::object object;
+    std::size_t size;
+};
+
+// Least recently used blobs go first once the capacity is exceeded
+class BlobCache {
+public:
+    static BlobCache &sharedInstance();
+
+    BlobCache(const BlobCache &) = delete;
+    void operator =(const BlobCache &) = delete;
+
+    void setCapacity(std::size_t bytes);
+
+    std::shared_ptr<const Blob> find(const std::string &digest);
+    std::shared_ptr<const Blob> insert(
+            const std::string &digest,
+            const char *data,
+            std::size_t size);
+
+private:
+    BlobCache();
+
+    using Entry = std::pair<std::string, std::shared_ptr<const Blob>>;
+
+    std::mutex _mutex;
+    std::size_t _capacity;
+    std::size_t _size;
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+};
+
+// Replaces the blob elements of the argument array with their contents,
+// caching inline ones. `hold` keeps them alive until the arguments are
+// converted. Throws BlobMissing if any reference is not cached.
+void resolveBlobs(
+        const msgpack::object &args,
+        std::vector<std::shared_ptr<const Blob>> &hold);
+
+}
+
+}
+
+namespace msgpack {
+
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+
+namespace adaptor {
+
+template<class T>
+struct pack<ecumene::Shared<T>> {
+    template<class Stream>
+    msgpack::packer<Stream> &operator ()(
+            msgpack::packer<Stream> &o,
+            const ecumene::Shared<T> &v) const
+    {
+        // The bytes packed for the digest, written as they are
+        const auto packed = v.packed();
+        return o.pack_bin_body(
+                packed->data(),
+                static_cast<std::uint32_t>(packed->size()));
+    }
+};
+
+}
+
+}
+
+}
+
+#endif /* ECUMENE_BLOB_H */
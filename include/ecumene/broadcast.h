@@ -0,0 +1,46 @@
+#ifndef ECUMENE_BROADCAST_H
+#define ECUMENE_BROADCAST_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+#include "ecumene/function_call_result.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Collects the answers to one broadcast. The client agent reports each
+// answer with receive() and their number with finish(), both through the
+// executor, so they may arrive in any order. `handler` runs once per answer,
+// one at a time, and `done` once after the last.
+class Broadcast {
+public:
+    using Handler = std::function<void(const FunctionCallResult &)>;
+    using Done = std::function<void()>;
+
+    Broadcast(const Handler &handler, const Done &done);
+
+    Broadcast(const Broadcast &) = delete;
+    void operator =(const Broadcast &) = delete;
+
+    void receive(const FunctionCallResult &result);
+    void finish(std::size_t answered);
+
+private:
+    std::mutex _mutex;
+    const Handler _handler;
+    const Done _done;
+    std::size_t _received;
+    std::size_t _answered;
+    bool _finished;
+
+    void settle(std::unique_lock<std::mutex> &lock);
+};
+
+}
+
+}
+
+#endif /* ECUMENE_BROADCAST_H */
@@ -0,0 +1,96 @@
+#ifndef ECUMENE_CALL_TABLE_H
+#define ECUMENE_CALL_TABLE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ecumene/function_call.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Pending calls by ID. Records live in fixed-size chunks and are recycled
+// through a free list, so steady-state traffic allocates nothing. IDs carry a
+// generation so that a late reply cannot hit a reused record. Deadlines are
+// kept in a heap that each record knows its place in, so erasing a call
+// removes its deadline too. Not thread-safe.
+class CallTable {
+public:
+    using Id = unsigned long long;
+
+    CallTable() = default;
+    ~CallTable();
+
+    CallTable(const CallTable &) = delete;
+    void operator =(const CallTable &) = delete;
+
+    Id insert(FunctionCall &&call);
+    FunctionCall *find(Id id);
+    void erase(Id id);
+
+    // Returns the ID of a call whose timeout has passed, or 0 if none. The
+    // call is not returned again.
+    Id nextExpired(const std::chrono::steady_clock::time_point &now);
+
+    std::size_t size() const;
+
+    // Calls `f(id, call)` for every call. `f` must not insert or erase.
+    template<class F>
+    void forEach(F &&f)
+    {
+        for (std::size_t c = 0; c < _chunks.size(); ++c) {
+            for (std::size_t i = 0; i < CHUNK_SIZE; ++i) {
+                Slot &s = _chunks[c][i];
+                if (s.used) {
+                    const Id index = c * CHUNK_SIZE + i;
+                    f((static_cast<Id>(s.generation) << 32) | index, *s.call());
+                }
+            }
+        }
+    }
+
+private:
+    static const std::size_t CHUNK_SIZE = 256;
+
+    // Position of a slot without a deadline in the heap
+    static const std::uint32_t NO_DEADLINE = ~std::uint32_t(0);
+
+    struct Slot {
+        std::uint32_t generation = 0;
+        std::uint32_t deadline = NO_DEADLINE;
+        bool used = false;
+        typename std::aligned_storage<
+            sizeof (FunctionCall), alignof(FunctionCall)>::type storage;
+
+        FunctionCall *call()
+        {
+            return reinterpret_cast<FunctionCall *>(&storage);
+        }
+    };
+
+    // Timeout and slot index, earliest first
+    using Deadline = std::pair<std::chrono::steady_clock::time_point, std::uint32_t>;
+
+    std::vector<std::unique_ptr<Slot[]>> _chunks;
+    std::vector<std::uint32_t> _free;
+    std::vector<Deadline> _deadlines;
+    std::size_t _size = 0;
+
+    Slot *slot(Id id);
+    Slot &at(std::uint32_t index);
+
+    void place(std::size_t position, const Deadline &deadline);
+    void siftUp(std::size_t position);
+    void siftDown(std::size_t position);
+    void removeDeadline(std::size_t position);
+};
+
+}
+
+}
+
+#endif /* ECUMENE_CALL_TABLE_H */
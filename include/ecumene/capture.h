@@ -0,0 +1,93 @@
+#ifndef ECUMENE_CAPTURE_H
+#define ECUMENE_CAPTURE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "ecumene/function_call.h"
+#include "ecumene/function_call_result.h"
+#include "ecumene/ref.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Capture files start with CAPTURE_MAGIC and hold one record per completed
+// call, in completion order:
+//
+//     u32 size            whole record, padding included
+//     u32 keySize
+//     u32 argsSize
+//     u32 headerSize
+//     u64 startedAt       nanoseconds since the epoch
+//     u64 latency         nanoseconds
+//     u32 resultSize
+//     u8  status          FunctionCallResult::Status
+//     u8  reserved[3]
+//     key, args, header
+//
+// Integers are little-endian and records padded to 8 bytes, so a mapped
+// file can be walked in place. Files are only ever appended to.
+static const char CAPTURE_MAGIC[8] = { 'E', 'C', 'M', 'C', 'A', 'P', '\0', '\1' };
+static const std::size_t CAPTURE_RECORD_HEADER = 40;
+
+struct CaptureEntry {
+    StringRef ecmKey;
+
+    // Exactly as sent: possibly compressed, with the header to match
+    StringRef args;
+    StringRef header;
+
+    std::chrono::nanoseconds startedAt;
+    std::chrono::nanoseconds latency;
+    std::size_t resultSize;
+    FunctionCallResult::Status status;
+};
+
+class CaptureWriter {
+public:
+    // Check ok() before use
+    explicit CaptureWriter(const std::string &path);
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter &) = delete;
+    void operator =(const CaptureWriter &) = delete;
+
+    bool ok() const;
+
+    // Calls sent with blob references are recorded with the blobs inline
+    void write(const FunctionCall &call, const FunctionCallResult &result);
+
+private:
+    std::mutex _mutex;
+    std::FILE *_file;
+};
+
+// Reads a capture file through a read-only mapping
+class CaptureReader {
+public:
+    // Throws std::runtime_error if the file can't be read
+    explicit CaptureReader(const std::string &path);
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader &) = delete;
+    void operator =(const CaptureReader &) = delete;
+
+    // False at the end of the file, or at a record cut short by a crash
+    bool next(CaptureEntry &entry);
+
+private:
+    const char *_data;
+    std::size_t _size;
+    std::size_t _offset;
+};
+
+}
+
+}
+
+#endif /* ECUMENE_CAPTURE_H */
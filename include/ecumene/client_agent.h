@@ -1,15 +1,22 @@
 #ifndef ECUMENE_CLIENT_AGENT_H
 #define ECUMENE_CLIENT_AGENT_H
 
-#include <condition_variable>
-#include <map>
+#include <atomic>
+#include <cstddef>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
+#include "ecumene/broadcast.h"
+#include "ecumene/call_table.h"
+#include "ecumene/capture.h"
+#include "ecumene/executor.h"
 #include "ecumene/function_call.h"
 
 typedef struct _zsock_t zsock_t;
+typedef struct _zactor_t zactor_t;
+typedef struct _zmsg_t zmsg_t;
 
 namespace ecumene {
 
@@ -21,27 +28,54 @@ public:
     ClientAgent(ClientAgent &&) = delete;
     void operator =(const ClientAgent &) = delete;
 
+    // Hands the call to the network thread right away; callable from any
+    // thread, including an event loop's
     void send(FunctionCall &&call);
 
+    // Where result callbacks run; a ThreadPoolExecutor by default, or a
+    // PollableExecutor to run them on an event loop
+    void setExecutor(const std::shared_ptr<Executor> &executor);
+
+    // Resolves and connects workers for these keys ahead of their first call
+    void prefetch(const std::vector<std::string> &ecmKeys);
+
+    // Remembers the endpoints in use in `path`. Endpoints already there are
+    // connected right away and checked with Ecumene in the background.
+    void setEndpointCache(const std::string &path);
+
+    // Appends every call completed from now on to the capture file at
+    // `path`, for tools/replay; an empty path stops capturing
+    void setCapture(const std::string &path);
+
 private:
     ClientAgent();
     ~ClientAgent();
 
     static void actorTask(zsock_t *pipe, void *args);
 
-    enum ActorStatus {
-        NotReady,
-        Ready,
-        SendRequested,
-        ShouldDestroy,
-        Destroyed
-    } actorStatus;
-    std::mutex actorLock;
-    std::condition_variable actorCV;
-    std::string sendId;
+    zactor_t *actor;
 
     std::mutex callsMutex;
-    std::map<unsigned long long, FunctionCall> calls;
+    detail::CallTable calls;
+
+    std::mutex executorMutex;
+    std::shared_ptr<Executor> executor;
+
+    std::mutex captureMutex;
+    std::shared_ptr<detail::CaptureWriter> capture;
+    std::atomic<bool> capturing;
+
+    // Sends a message to the actor through the calling thread's socket
+    void command(zmsg_t *msg);
+    void complete(FunctionCall &&call, FunctionCallResult &&result);
+
+    // Broadcasts report each answer, then how many there were
+    void receive(
+            const std::shared_ptr<detail::Broadcast> &broadcast,
+            FunctionCallResult &&result);
+    void finish(
+            const std::shared_ptr<detail::Broadcast> &broadcast,
+            std::size_t answered);
 };
 
 }
@@ -0,0 +1,37 @@
+#ifndef ECUMENE_COMPRESSION_H
+#define ECUMENE_COMPRESSION_H
+
+#include <cstddef>
+#include <limits>
+
+#include <msgpack.hpp>
+
+typedef struct _zframe_t zframe_t;
+
+namespace ecumene {
+
+constexpr std::size_t NoCompression = std::numeric_limits<std::size_t>::max();
+
+namespace detail {
+
+// Creates a payload frame, LZ4-compressing the data when it is at least
+// `threshold` bytes long and compression actually shrinks it.
+zframe_t *makePayloadFrame(
+        const char *data,
+        std::size_t size,
+        std::size_t threshold,
+        bool &compressed);
+
+// Unpacks a payload into `zone`; compressed payloads are decompressed into
+// a reused per-thread buffer and parsed in place.
+msgpack::object unpackPayload(
+        const char *data,
+        std::size_t size,
+        bool compressed,
+        msgpack::zone &zone);
+
+}
+
+}
+
+#endif /* ECUMENE_COMPRESSION_H */
@@ -0,0 +1,237 @@
+#ifndef ECUMENE_DECODER_H
+#define ECUMENE_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <msgpack.hpp>
+
+#include "ecumene/ref.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Walks a MessagePack buffer in place. Mismatched types throw
+// msgpack::type_error, like msgpack::object::as does; running off the end
+// throws InvalidArgument.
+class Reader {
+public:
+    Reader(const char *data, std::size_t size);
+
+    bool readBool();
+    double readFloat();
+
+    // Integers that don't fit `T` are type errors
+    template<class T>
+    T readInteger()
+    {
+        bool negative;
+        const std::uint64_t bits = readIntegerBits(negative);
+        if (negative) {
+            const auto value = static_cast<std::int64_t>(bits);
+            if (std::is_unsigned<T>::value ||
+                    value < static_cast<std::int64_t>(std::numeric_limits<T>::min())) {
+                throw msgpack::type_error();
+            }
+            return static_cast<T>(value);
+        }
+        if (bits > static_cast<std::uint64_t>(std::numeric_limits<T>::max())) {
+            throw msgpack::type_error();
+        }
+        return static_cast<T>(bits);
+    }
+
+    // Strings and binaries are interchangeable, as with msgpack::object
+    StringRef readString();
+
+    // Body of an extension, and its type
+    StringRef readExt(std::int8_t &type);
+
+    // Lengths no longer than what is left of the buffer could hold, so
+    // they are safe to reserve for
+    std::uint32_t readArray();
+    std::uint32_t readMap();
+    void skip();
+
+    // Parses one value the slow way, into `zone`
+    msgpack::object readObject(msgpack::zone &zone);
+
+private:
+    const char *_data;
+    std::size_t _size;
+    std::size_t _offset;
+
+    unsigned char peek() const;
+    const char *take(std::size_t n);
+    std::uint64_t readBigEndian(std::size_t n);
+    std::uint64_t readIntegerBits(bool &negative);
+    std::uint32_t checkLength(std::uint64_t n, std::size_t minBytes) const;
+};
+
+// Decodes a `T` straight from the buffer. Types without a specialization go
+// through msgpack::object, one value at a time.
+template<class T, class Enable = void>
+struct Decode {
+    static T read(Reader &reader, msgpack::zone &zone)
+    {
+        return reader.readObject(zone).as<T>();
+    }
+};
+
+template<>
+struct Decode<bool> {
+    static bool read(Reader &reader, msgpack::zone &)
+    {
+        return reader.readBool();
+    }
+};
+
+template<class T>
+struct Decode<T, typename std::enable_if<
+    std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static T read(Reader &reader, msgpack::zone &)
+    {
+        return reader.readInteger<T>();
+    }
+};
+
+template<class T>
+struct Decode<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static T read(Reader &reader, msgpack::zone &)
+    {
+        return static_cast<T>(reader.readFloat());
+    }
+};
+
+template<>
+struct Decode<std::string> {
+    static std::string read(Reader &reader, msgpack::zone &)
+    {
+        const StringRef s = reader.readString();
+        return std::string(s.data(), s.size());
+    }
+};
+
+template<>
+struct Decode<StringRef> {
+    static StringRef read(Reader &reader, msgpack::zone &)
+    {
+        return reader.readString();
+    }
+};
+
+template<>
+struct Decode<BytesRef> {
+    static BytesRef read(Reader &reader, msgpack::zone &)
+    {
+        const StringRef s = reader.readString();
+        return BytesRef(s.data(), s.size());
+    }
+};
+
+template<class T, class A>
+struct Decode<std::vector<T, A>, typename std::enable_if<
+    !std::is_same<T, char>::value && !std::is_same<T, unsigned char>::value>::type> {
+    static std::vector<T, A> read(Reader &reader, msgpack::zone &zone)
+    {
+        const std::uint32_t n = reader.readArray();
+        std::vector<T, A> v;
+        v.reserve(n);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            v.push_back(Decode<T>::read(reader, zone));
+        }
+        return v;
+    }
+};
+
+// Byte vectors come from binaries
+template<class T, class A>
+struct Decode<std::vector<T, A>, typename std::enable_if<
+    std::is_same<T, char>::value || std::is_same<T, unsigned char>::value>::type> {
+    static std::vector<T, A> read(Reader &reader, msgpack::zone &)
+    {
+        const StringRef s = reader.readString();
+        const T *data = reinterpret_cast<const T *>(s.data());
+        return std::vector<T, A>(data, data + s.size());
+    }
+};
+
+template<class K, class V, class C, class A>
+struct Decode<std::map<K, V, C, A>> {
+    static std::map<K, V, C, A> read(Reader &reader, msgpack::zone &zone)
+    {
+        const std::uint32_t n = reader.readMap();
+        std::map<K, V, C, A> m;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            K key = Decode<K>::read(reader, zone);
+            m[std::move(key)] = Decode<V>::read(reader, zone);
+        }
+        return m;
+    }
+};
+
+// Extra elements are skipped, missing ones are type errors
+template<class ... Types>
+struct Decode<std::tuple<Types...>> {
+    static std::tuple<Types...> read(Reader &reader, msgpack::zone &zone)
+    {
+        const std::uint32_t n = reader.readArray();
+        if (n < sizeof...(Types)) {
+            throw msgpack::type_error();
+        }
+
+        // Braced initializers are evaluated in order
+        std::tuple<Types...> t { Decode<Types>::read(reader, zone)... };
+
+        for (std::uint32_t i = sizeof...(Types); i < n; ++i) {
+            reader.skip();
+        }
+        return t;
+    }
+};
+
+template<class T>
+T decode(const char *data, std::size_t size, msgpack::zone &zone)
+{
+    Reader reader(data, size);
+    return Decode<T>::read(reader, zone);
+}
+
+// Whether a decoded `T` may point into the buffer it came from
+template<class T>
+struct HoldsRefs: std::false_type {};
+
+template<>
+struct HoldsRefs<StringRef>: std::true_type {};
+
+template<>
+struct HoldsRefs<BytesRef>: std::true_type {};
+
+template<class T, class A>
+struct HoldsRefs<std::vector<T, A>>: HoldsRefs<T> {};
+
+template<class K, class V, class C, class A>
+struct HoldsRefs<std::map<K, V, C, A>>:
+    std::integral_constant<bool, HoldsRefs<K>::value || HoldsRefs<V>::value> {};
+
+template<>
+struct HoldsRefs<std::tuple<>>: std::false_type {};
+
+template<class T, class ... Types>
+struct HoldsRefs<std::tuple<T, Types...>>: std::integral_constant<bool,
+    HoldsRefs<typename std::decay<T>::type>::value ||
+    HoldsRefs<std::tuple<Types...>>::value> {};
+
+}
+
+}
+
+#endif /* ECUMENE_DECODER_H */
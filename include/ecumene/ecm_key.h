@@ -0,0 +1,22 @@
+#ifndef ECUMENE_ECM_KEY_H
+#define ECUMENE_ECM_KEY_H
+
+#include <cstdint>
+#include <string>
+
+namespace ecumene {
+
+namespace detail {
+
+// Process-wide handle for an ecmKey, so that the hot path compares integers
+// instead of strings. Handles are never released.
+using EcmKey = std::uint32_t;
+
+EcmKey internEcmKey(const std::string &ecmKey);
+const std::string &ecmKeyName(EcmKey key);
+
+}
+
+}
+
+#endif /* ECUMENE_ECM_KEY_H */
@@ -0,0 +1,103 @@
+#ifndef ECUMENE_EXECUTOR_H
+#define ECUMENE_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ecumene/inline_function.h"
+
+namespace ecumene {
+
+// Runs call completions so that user callbacks never block the network
+// thread. Implementations must be thread-safe.
+class Executor {
+public:
+    using Task = detail::InlineFunction<void(), 128>;
+
+    virtual ~Executor() = default;
+
+    virtual void execute(Task &&task) = 0;
+};
+
+// Runs tasks right away on the calling thread, i.e. on the network thread
+// for completions. Only for callbacks that never block.
+class InlineExecutor: public Executor {
+public:
+    void execute(Task &&task) override;
+};
+
+// Queues tasks for an event loop the application runs itself. The file
+// descriptor becomes readable once tasks are waiting, and drain() runs them
+// on the calling thread.
+class PollableExecutor: public Executor {
+public:
+    PollableExecutor();
+    ~PollableExecutor();
+
+    PollableExecutor(const PollableExecutor &) = delete;
+    void operator =(const PollableExecutor &) = delete;
+
+    void execute(Task &&task) override;
+
+    int fd() const;
+
+    // Runs the tasks queued so far and returns how many there were. Only
+    // one thread may drain at a time. An exception thrown by a task is
+    // passed on to the caller, as ThreadPoolExecutor lets its threads end
+    // on one; the tasks behind it run on the next drain.
+    std::size_t drain();
+
+private:
+    std::mutex _mutex;
+    std::vector<Task> _tasks;
+    std::vector<Task> _running;
+
+    // Written once per batch, so a busy loop costs no extra system calls
+    int _pipe[2];
+    bool _signalled;
+
+    // Makes the descriptor readable; called with the mutex held
+    void signal();
+};
+
+// Fixed pool of threads, each with its own queue. Tasks submitted from a pool
+// thread stay on that thread's queue; idle threads steal from the others.
+class ThreadPoolExecutor: public Executor {
+public:
+    explicit ThreadPoolExecutor(
+            std::size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPoolExecutor();
+
+    ThreadPoolExecutor(const ThreadPoolExecutor &) = delete;
+    void operator =(const ThreadPoolExecutor &) = delete;
+
+    void execute(Task &&task) override;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<std::size_t> _next;
+
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeup;
+    std::size_t _pending;
+    bool _stopping;
+
+    void run(std::size_t index);
+    bool pop(std::size_t index, Task &task);
+};
+
+}
+
+#endif /* ECUMENE_EXECUTOR_H */
@@ -1,18 +1,183 @@
 #ifndef ECUMENE_FUNCTION_H
 #define ECUMENE_FUNCTION_H
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <future>
+#include <limits>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 
 #include <msgpack.hpp>
 
 #include "ecumene/base_function.h"
+#include "ecumene/broadcast.h"
 #include "ecumene/client_agent.h"
+#include "ecumene/decoder.h"
+#include "ecumene/latch.h"
+#include "ecumene/pool.h"
+#include "ecumene/raw_codec.h"
+#include "ecumene/stream.h"
 
 namespace ecumene {
 
+namespace detail {
+
+// Decodes a successful result and hands it to the caller's callback
+template<class R, class RawCodec>
+struct Delivery {
+    template<class S>
+    static void deliver(const FunctionCallResult &result, const S &success)
+    {
+        if (result.header().has(MessageHeader::Raw)) {
+            if (result.header().schema != RawCodec::schema) {
+                throw InvalidArgument("raw schema mismatch");
+            }
+            success(RawCodec::unpackResult(result.data(), result.size()));
+        } else if (!result.header().has(MessageHeader::Compressed)) {
+            Pooled<msgpack::zone> zone;
+            success(decode<R>(result.data(), result.size(), *zone));
+        } else {
+            Pooled<msgpack::zone> zone;
+            success(result.unpack(*zone).as<R>());
+        }
+    }
+
+    static auto fulfil(const std::shared_ptr<std::promise<R>> &p)
+    {
+        return [p](const R &result) {
+            p->set_value(result);
+        };
+    }
+
+    template<class Slot>
+    static auto store(Slot *slot)
+    {
+        return [slot](R &&result) {
+            slot->set(std::move(result));
+        };
+    }
+};
+
+template<class RawCodec>
+struct Delivery<void, RawCodec> {
+    template<class S>
+    static void deliver(const FunctionCallResult &, const S &success)
+    {
+        success();
+    }
+
+    static auto fulfil(const std::shared_ptr<std::promise<void>> &p)
+    {
+        return [p]() {
+            p->set_value();
+        };
+    }
+
+    template<class Slot>
+    static auto store(Slot *slot)
+    {
+        return [slot]() {
+            slot->set();
+        };
+    }
+};
+
+// Result of a blocking call, kept on the caller's stack. The network
+// thread writes it in place and then wakes the caller.
+template<class R>
+class SyncResult {
+public:
+    SyncResult() = default;
+
+    SyncResult(const SyncResult &) = delete;
+    void operator =(const SyncResult &) = delete;
+
+    ~SyncResult()
+    {
+        if (_ready) {
+            value().~R();
+        }
+    }
+
+    void set(R &&result)
+    {
+        new (&_storage) R(std::move(result));
+        _ready = true;
+    }
+
+    void fail(const std::exception_ptr &eptr)
+    {
+        _eptr = eptr;
+    }
+
+    void open()
+    {
+        _latch.open();
+    }
+
+    R get(const std::chrono::microseconds &spin)
+    {
+        _latch.wait(spin);
+        if (_eptr) {
+            std::rethrow_exception(_eptr);
+        }
+        return std::move(value());
+    }
+
+private:
+    typename std::aligned_storage<sizeof (R), alignof(R)>::type _storage;
+    bool _ready = false;
+    std::exception_ptr _eptr;
+    Latch _latch;
+
+    R &value()
+    {
+        return *reinterpret_cast<R *>(&_storage);
+    }
+};
+
+template<>
+class SyncResult<void> {
+public:
+    SyncResult() = default;
+
+    SyncResult(const SyncResult &) = delete;
+    void operator =(const SyncResult &) = delete;
+
+    void set()
+    {
+    }
+
+    void fail(const std::exception_ptr &eptr)
+    {
+        _eptr = eptr;
+    }
+
+    void open()
+    {
+        _latch.open();
+    }
+
+    void get(const std::chrono::microseconds &spin)
+    {
+        _latch.wait(spin);
+        if (_eptr) {
+            std::rethrow_exception(_eptr);
+        }
+    }
+
+private:
+    std::exception_ptr _eptr;
+    Latch _latch;
+};
+
+}
+
 template<class T>
 class Function;
 
@@ -21,16 +186,45 @@ class Function<R(Args...)>: protected BaseFunction {
 public:
     using BaseFunction::BaseFunction;
     using BaseFunction::setTimeout;
+    using BaseFunction::setCompressionThreshold;
+    using BaseFunction::setIdempotent;
+    using BaseFunction::setBlobThreshold;
+    using BaseFunction::setSpin;
+    using BaseFunction::setPriority;
+    using BaseFunction::setUploadWindow;
+    using BaseFunction::prefetch;
+
+    // Sends arguments in a fixed binary layout instead of MessagePack.
+    // Only for trivially copyable signatures, and the worker must be built
+    // from the same types.
+    void setRawEncoding(bool enabled)
+    {
+        static_assert(detail::AllRaw<R, Args...>::value,
+                "raw encoding requires trivially copyable types");
+        _raw = enabled;
+    }
+
+    // Sends calls with equal values of argument `index` to the same worker
+    // of the key, so that state it keeps for them stays warm. Few move when
+    // workers join or leave. NoPartitionKey, the default, turns it off.
+    void setPartitionKey(std::size_t index)
+    {
+        if (index != NoPartitionKey && index >= sizeof...(Args)) {
+            throw std::out_of_range("no such argument");
+        }
+        _partitionKey = index;
+    }
 
     std::future<R> getFuture(Args ... args)
     {
+        static_assert(!detail::HoldsRefs<R>::value,
+                "reference results are only valid inside a callback");
+
         auto p = std::make_shared<std::promise<R>>();
 
         withCallback(
                 args...,
-                [p](const R &result) {
-                    p->set_value(result);
-                },
+                Delivery::fulfil(p),
                 [p](const std::exception_ptr &eptr) {
                     p->set_exception(eptr);
                 });
@@ -41,43 +235,250 @@ public:
     template<class T, class U>
     void withCallback(Args ... args, const T &&success, const U &&error)
     {
-        // Pack arguments into buffer
-        msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, std::forward_as_tuple(args...));
+        submit(
+                args...,
+                FunctionCallResultCallback([
+                        this,
+                        success = std::move(success),
+                        error = std::move(error)](const FunctionCallResult &&result) {
+                    handle(result, success, error);
+                }),
+                false);
+    }
 
-        FunctionCallResultCallback callback([
-                this,
-                success = std::move(success),
-                error = std::move(error)](const FunctionCallResult &&result) {
+    // One-way call: the worker runs the function but sends nothing back,
+    // and nothing is kept around once the request is on its way. Errors,
+    // including an unknown ecmKey, go unnoticed.
+    void post(Args ... args)
+    {
+        static_assert(!detail::AnyOf<detail::IsUpload, Args...>::value,
+                "uploads need a call that is answered");
 
-            // Handle error
-            std::exception_ptr eptr = handleError(result);
-            if (eptr) {
-                error(eptr);
-                return;
-            }
+        detail::Pooled<msgpack::sbuffer> sbuf;
+        detail::MessageHeader header;
+        header.set(detail::MessageHeader::OneWay);
+        pack(*sbuf, header, args...);
+
+        FunctionCall call(
+                _keyId,
+                *sbuf,
+                FunctionCallResultCallback(),
+                _timeout,
+                raw() ? NoCompression : _compressionThreshold,
+                header);
+        route(call, args...);
+
+        ClientAgent::sharedInstance().send(std::move(call));
+    }
+
+    // Calls every worker registered under the key at once. `success` or
+    // `error` runs for each worker that answers, one at a time, and `done`
+    // once after the last, or at the timeout with whatever arrived by then.
+    template<class S, class E, class D>
+    void broadcastWithCallback(
+            Args ... args,
+            const S &&success,
+            const E &&error,
+            const D &&done)
+    {
+        static_assert(!detail::AnyOf<detail::IsUpload, Args...>::value,
+                "uploads go to a single worker");
+
+        detail::Pooled<msgpack::sbuffer> sbuf;
+        detail::MessageHeader header;
+        pack(*sbuf, header, args...);
 
-            // Try to unpack
-            try {
-                msgpack::unpacked msg;
-                msgpack::unpack(&msg, result.data(), result.size());
-                success(msg.get().as<R>());
-            } catch (...) {
-                error(std::current_exception());
+        FunctionCall call(
+                _keyId,
+                *sbuf,
+                FunctionCallResultCallback(),
+                _timeout,
+                raw() ? NoCompression : _compressionThreshold,
+                header);
+        call.broadcast = std::make_shared<detail::Broadcast>(
+                [this, success, error](const FunctionCallResult &result) {
+                    handle(result, success, error);
+                },
+                done);
+
+        ClientAgent::sharedInstance().send(std::move(call));
+    }
+
+    // Folds the results of every worker that answers in time with
+    // `reduce(accumulator, result)`. Failed workers are left out.
+    template<class A, class F>
+    std::future<A> broadcast(Args ... args, A initial, F reduce)
+    {
+        static_assert(!detail::HoldsRefs<A>::value,
+                "reference results are only valid inside a callback");
+
+        auto p = std::make_shared<std::promise<A>>();
+        auto accumulator = std::make_shared<A>(std::move(initial));
+
+        broadcastWithCallback(
+                args...,
+                [accumulator, reduce](const R &result) {
+                    *accumulator = reduce(std::move(*accumulator), result);
+                },
+                [](const std::exception_ptr &) {},
+                [p, accumulator]() {
+                    p->set_value(std::move(*accumulator));
+                });
+
+        return p->get_future();
+    }
+
+    // Blocks until the result arrives, without a promise or an executor
+    // hop: the result is decoded on the network thread straight into this
+    // frame, which is then woken.
+    R operator ()(Args ... args)
+    {
+        static_assert(!detail::HoldsRefs<R>::value,
+                "reference results are only valid inside a callback");
+
+        detail::SyncResult<R> slot;
+        detail::SyncResult<R> *const target = &slot;
+
+        submit(
+                args...,
+                FunctionCallResultCallback([this, target](const FunctionCallResult &&result) {
+                    handle(
+                            result,
+                            Delivery::store(target),
+                            [target](const std::exception_ptr &eptr) {
+                                target->fail(eptr);
+                            });
+                    target->open();
+                }),
+                true);
+
+        return slot.get(_spin);
+    }
+
+    // A function that calls this one and has its worker pass the result
+    // straight on to `next`'s. Only the final result comes back, relayed
+    // along the chain, so each stage saves a round trip through the caller.
+    template<class R2, class A>
+    Function<R2(Args...)> then(const Function<R2(A)> &next) const
+    {
+        static_assert(std::is_same<typename std::decay<A>::type, R>::value,
+                "next function must take this one's result");
+
+        Function<R2(Args...)> chained(_ecmKey);
+        static_cast<BaseFunction &>(chained) = *this;
+        chained._chain.push_back(next._ecmKey);
+        chained._chain.insert(
+                chained._chain.end(), next._chain.cbegin(), next._chain.cend());
+        return chained;
+    }
+
+private:
+    template<class T>
+    friend class Function;
+
+    using RawCodec = detail::RawCodecFor<R, Args...>;
+    using Delivery = detail::Delivery<R, RawCodec>;
+
+    bool _raw = false;
+
+    // Chained results are passed on as MessagePack
+    bool raw() const
+    {
+        return _raw && _chain.empty();
+    }
+
+    // Chained calls tell each worker how long the caller waits
+    std::uint32_t budget() const
+    {
+        if (_chain.empty()) {
+            return 0;
+        }
+        return static_cast<std::uint32_t>(std::min<std::chrono::milliseconds::rep>(
+                    std::chrono::milliseconds(_timeout).count(),
+                    std::numeric_limits<std::uint32_t>::max()));
+    }
+
+    void submit(Args ... args, FunctionCallResultCallback &&callback, bool direct)
+    {
+        const auto upload = detail::findUpload(args...);
+
+        detail::Pooled<msgpack::sbuffer> sbuf;
+        detail::BlobArguments blobs;
+        detail::MessageHeader header;
+        if (raw() || _blobThreshold == NoBlobs || upload) {
+            pack(*sbuf, header, args...);
+        } else {
+            if (detail::packBlobs(*sbuf, blobs, _blobThreshold, args...)) {
+                header.set(detail::MessageHeader::Blobs);
             }
-        });
+            header.chain = _chain;
+            header.priority = _priority;
+            header.budget = budget();
+        }
+
+        // The upload follows the call, and can't be sent twice
+        if (upload) {
+            header.set(detail::MessageHeader::Streamed);
+        }
+
+        FunctionCall call(
+                _keyId,
+                *sbuf,
+                std::move(callback),
+                _timeout,
+                raw() || upload ? NoCompression : _compressionThreshold,
+                header);
+        call.idempotent = _idempotent && !upload;
+        call.direct = direct;
+        call.upload = upload;
+        call.credits = _uploadWindow;
+        call.blobs = std::move(blobs);
+        route(call, args...);
 
         // Pass to network agent
-        ClientAgent::sharedInstance().send(FunctionCall(
-                    _ecmKey,
-                    std::move(sbuf),
-                    std::move(callback),
-                    _timeout));
+        ClientAgent::sharedInstance().send(std::move(call));
     }
 
-    R operator ()(Args ... args)
+    void route(FunctionCall &call, const Args &... args) const
     {
-        return getFuture(args...).get();
+        if (_partitionKey != NoPartitionKey) {
+            call.partitioned = true;
+            call.partition = detail::partitionHashOf(_partitionKey, args...);
+        }
+    }
+
+    template<class S, class E>
+    void handle(const FunctionCallResult &result, const S &success, const E &error) const
+    {
+        // Handle error
+        std::exception_ptr eptr = handleError(result);
+        if (eptr) {
+            error(eptr);
+            return;
+        }
+
+        // Try to unpack
+        try {
+            Delivery::deliver(result, success);
+        } catch (...) {
+            error(std::current_exception());
+        }
+    }
+
+    // Pack arguments into buffer
+    void pack(msgpack::sbuffer &sbuf, detail::MessageHeader &header, const Args &... args)
+    {
+        header.chain = _chain;
+        header.priority = _priority;
+        header.budget = budget();
+
+        if (raw()) {
+            RawCodec::packArgs(sbuf, args...);
+            header.set(detail::MessageHeader::Raw);
+            header.schema = RawCodec::schema;
+        } else {
+            msgpack::pack(sbuf, std::forward_as_tuple(args...));
+        }
     }
 };
 
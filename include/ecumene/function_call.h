@@ -2,32 +2,92 @@
 #define ECUMENE_FUNCTION_CALL_H
 
 #include <chrono>
-#include <functional>
-#include <string>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 
 #include <msgpack.hpp>
 
+#include "ecumene/blob.h"
+#include "ecumene/compression.h"
+#include "ecumene/ecm_key.h"
 #include "ecumene/function_call_result.h"
+#include "ecumene/message_header.h"
 
-typedef struct _zmsg_t zmsg_t;
+typedef struct _zframe_t zframe_t;
+typedef struct _zsock_t zsock_t;
 
 namespace ecumene {
 
+namespace detail {
+
+class Broadcast;
+class UploadSource;
+
+}
+
 struct FunctionCall {
-    const std::string ecmKey;
-    zmsg_t *args;
-    const std::function<void(const FunctionCallResult &&)> callback;
+    detail::EcmKey ecmKey;
+    zframe_t *args;
+
+    // Null when the request carries no header
+    zframe_t *header;
+
+    // Arguments sent by reference, put back inline if the worker is
+    // missing some
+    detail::BlobArguments blobs;
+    std::size_t compressionThreshold;
+
+    FunctionCallResultCallback callback;
+    std::chrono::steady_clock::time_point startedAt;
     std::chrono::steady_clock::time_point timeoutAt;
+    Priority priority;
+
+    // Written to a worker socket. Idempotent calls keep their frames so they
+    // can be sent again if that worker goes away.
+    bool sent;
+    bool idempotent;
+
+    // Run on the network thread instead of the executor. Only for callbacks
+    // that do little more than wake a waiting caller.
+    bool direct;
+
+    // Recorded on completion, so its frames are kept after sending
+    bool captured;
+
+    // Set for broadcasts, which take the place of the callback and stay in
+    // flight until every worker asked has answered
+    std::shared_ptr<detail::Broadcast> broadcast;
+    std::size_t asked;
+    std::size_t answered;
+
+    // Set for streamed calls. Chunks are sent while the worker has granted
+    // credits, starting with the upload window.
+    std::shared_ptr<detail::UploadSource> upload;
+    std::size_t credits;
+    bool uploaded;
+
+    // Set for calls routed by a partition key, which go to the worker of the
+    // key's live set that `partition` hashes to
+    bool partitioned;
+    std::uint64_t partition;
+
+    // Socket a partitioned call was last sent on
+    zsock_t *peer;
 
     explicit FunctionCall(
-            const std::string &ecmKey,
+            detail::EcmKey ecmKey,
             const msgpack::sbuffer &sbuf,
-            const std::function<void(const FunctionCallResult &&)> &callback,
-            const std::chrono::seconds &timeout);
-    FunctionCall(FunctionCall &&other);
+            FunctionCallResultCallback &&callback,
+            const std::chrono::milliseconds &timeout,
+            std::size_t compressionThreshold = NoCompression,
+            detail::MessageHeader header = detail::MessageHeader());
+    FunctionCall(FunctionCall &&other) noexcept;
     ~FunctionCall();
 
+    // Replaces the blob references in `args` with the blobs
+    void inlineBlobs();
+
     FunctionCall() = delete;
     FunctionCall(const FunctionCall &) = delete;
     void operator =(const FunctionCall &) = delete;
@@ -2,7 +2,11 @@
 #define ECUMENE_FUNCTION_CALL_RESULT_H
 
 #include <cstddef>
-#include <functional>
+
+#include <msgpack.hpp>
+
+#include "ecumene/inline_function.h"
+#include "ecumene/message_header.h"
 
 typedef struct _zframe_t zframe_t;
 
@@ -18,8 +22,11 @@ public:
         UnknownError
     };
 
-    explicit FunctionCallResult(zframe_t **statusPtr, zframe_t **resultPtr);
-    FunctionCallResult(FunctionCallResult &&other);
+    explicit FunctionCallResult(
+            zframe_t **statusPtr,
+            zframe_t **resultPtr,
+            const detail::MessageHeader &header = detail::MessageHeader());
+    FunctionCallResult(FunctionCallResult &&other) noexcept;
     ~FunctionCallResult();
 
     FunctionCallResult() = delete;
@@ -29,14 +36,17 @@ public:
     Status status() const;
     const char *data() const;
     std::size_t size() const;
+    const detail::MessageHeader &header() const;
+    msgpack::object unpack(msgpack::zone &zone) const;
 
 private:
     Status _status;
     zframe_t *_result;
+    detail::MessageHeader _header;
 };
 
 using FunctionCallResultCallback =
-    std::function<void(const FunctionCallResult &&)>;
+    detail::InlineFunction<void(const FunctionCallResult &&)>;
 
 }
 
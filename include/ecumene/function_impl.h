@@ -1,13 +1,23 @@
 #ifndef ECUMENE_FUNCTION_IMPL_H
 #define ECUMENE_FUNCTION_IMPL_H
 
+#include <memory>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <msgpack.hpp>
 
+#include "ecumene/blob.h"
+#include "ecumene/compression.h"
+#include "ecumene/decoder.h"
 #include "ecumene/exception.h"
+#include "ecumene/future.h"
 #include "ecumene/heartbeat_service.h"
 #include "ecumene/memory.h"
+#include "ecumene/pool.h"
+#include "ecumene/raw_codec.h"
+#include "ecumene/stream.h"
 #include "ecumene/worker_agent.h"
 
 #define UNUSED(x) (void)(x)
@@ -34,6 +44,152 @@ auto applyTuple(Fnc &&fnc, const std::tuple<Types...> &tuple)
             std::index_sequence_for<Types...>());
 }
 
+// Keeps alive whatever decoded arguments point into, besides the request
+// frame itself
+struct DecodeScope {
+    Pooled<msgpack::zone> zone;
+    std::vector<std::shared_ptr<const Blob>> blobs;
+};
+
+template<class R, class ... Args>
+std::tuple<Args...> decodeArgs(
+        const char *data,
+        std::size_t size,
+        const MessageHeader &header,
+        DecodeScope &scope)
+{
+    if (header.has(MessageHeader::Raw)) {
+        // Fixed binary layout, rejected unless every type is safe to copy
+        // from the wire as is
+        if (header.has(MessageHeader::Compressed)) {
+            throw InvalidArgument("compressed raw payload");
+        }
+        return RawCodecFor<R, Args...>::unpackArgs(header.schema, data, size);
+    }
+
+    // Plain payloads are decoded straight from the frame
+    if (!header.has(MessageHeader::Compressed) && !header.has(MessageHeader::Blobs)) {
+        return decode<std::tuple<Args...>>(data, size, *scope.zone);
+    }
+
+    const msgpack::object args = unpackPayload(
+            data,
+            size,
+            header.has(MessageHeader::Compressed),
+            *scope.zone);
+
+    if (header.has(MessageHeader::Blobs)) {
+        resolveBlobs(args, scope.blobs);
+    }
+    return args.as<std::tuple<Args...>>();
+}
+
+// Sends a handler's result back to the caller
+template<class R, class ... Args>
+struct Completion {
+    using Value = R;
+    using RawCodec = RawCodecFor<R, Args...>;
+
+    template<class F>
+    static void invoke(
+            const F &func,
+            const std::tuple<Args...> &args,
+            bool raw,
+            const WorkerReply &reply)
+    {
+        complete(applyTuple(func, args), raw, reply);
+    }
+
+    static void complete(const R &result, bool raw, const WorkerReply &reply)
+    {
+        Pooled<msgpack::sbuffer> sbuf;
+        MessageHeader header;
+        if (raw) {
+            RawCodec::packResult(*sbuf, result);
+            header.set(MessageHeader::Raw);
+            header.schema = RawCodec::schema;
+        } else {
+            msgpack::pack(*sbuf, result);
+        }
+
+        reply.succeed(*sbuf, header);
+    }
+};
+
+// Void handlers answer with nil
+template<class ... Args>
+struct Completion<void, Args...> {
+    using Value = void;
+
+    template<class F>
+    static void invoke(
+            const F &func,
+            const std::tuple<Args...> &args,
+            bool,
+            const WorkerReply &reply)
+    {
+        applyTuple(func, args);
+        complete(reply);
+    }
+
+    static void complete(const WorkerReply &reply)
+    {
+        static const char NIL = static_cast<char>(0xc0);
+        Pooled<msgpack::sbuffer> sbuf;
+        sbuf->write(&NIL, 1);
+        reply.succeed(*sbuf);
+    }
+};
+
+// Asynchronous handlers are answered from whichever thread completes the
+// future, so the worker keeps serving requests in the meantime
+template<class T, class ... Args>
+struct Completion<Future<T>, Args...> {
+    using Value = T;
+
+    template<class F>
+    static void invoke(
+            const F &func,
+            const std::tuple<Args...> &args,
+            bool raw,
+            const WorkerReply &reply)
+    {
+        complete(applyTuple(func, args), raw, reply);
+    }
+
+    static void complete(Future<T> result, bool raw, const WorkerReply &reply)
+    {
+        result.then(
+                [raw, reply](const T &value) {
+                    Completion<T, Args...>::complete(value, raw, reply);
+                },
+                [reply](const std::exception_ptr &eptr) {
+                    reply.fail(eptr);
+                });
+    }
+};
+
+template<class ... Args>
+struct Completion<Future<void>, Args...> {
+    using Value = void;
+
+    template<class F>
+    static void invoke(
+            const F &func,
+            const std::tuple<Args...> &args,
+            bool,
+            const WorkerReply &reply)
+    {
+        applyTuple(func, args).then(
+                [reply]() {
+                    Completion<void, Args...>::complete(reply);
+                },
+                [reply](const std::exception_ptr &eptr) {
+                    reply.fail(eptr);
+                });
+    }
+};
+
 }
 
 template<class T>
@@ -41,6 +197,10 @@ class FunctionImpl;
 
 template<class R, class ... Args>
 class FunctionImpl<R(Args...)> {
+    static_assert(!detail::AnyOf<detail::IsChunkStream, Args...>::value ||
+            detail::IsFuture<R>::value,
+            "handlers reading a stream must return a Future");
+
 public:
     explicit FunctionImpl(
             const std::string &ecmKey,
@@ -54,11 +214,20 @@ public:
                 ecmKey,
                 localEndpoint,
                 publicEndpoint,
-                [this](const msgpack::unpacked &unpacked, msgpack::sbuffer &sbuf) {
-                    auto result = detail::applyTuple(
+                [this](
+                        const char *data,
+                        std::size_t size,
+                        const detail::MessageHeader &requestHeader,
+                        const WorkerReply &reply) {
+                    // Raw requests are answered in kind. Reference
+                    // arguments stay valid until the handler returns.
+                    detail::DecodeScope scope;
+                    Completion::invoke(
                             _func,
-                            unpacked.get().as<decltype(_argsTuple)>());
-                    msgpack::pack(sbuf, result);
+                            detail::decodeArgs<Value, Args...>(
+                                data, size, requestHeader, scope),
+                            requestHeader.has(detail::MessageHeader::Raw),
+                            reply);
                 })
     {
         HeartbeatService::sharedInstance().registerWorker(
@@ -79,6 +248,19 @@ public:
         return _func(args...);
     }
 
+    void setCompressionThreshold(std::size_t threshold)
+    {
+        _agent.setCompressionThreshold(threshold);
+    }
+
+    // Off by default, since registries that predate load reports may not
+    // accept the extra heartbeat frame
+    void setLoadReporting(bool enabled)
+    {
+        HeartbeatService::sharedInstance().setWorkerLoad(
+                _ecmKey, _publicEndpoint, enabled ? _agent.load() : nullptr);
+    }
+
     void unregister()
     {
         HeartbeatService::sharedInstance().unregisterWorker(
@@ -86,11 +268,13 @@ public:
     }
 
 private:
+    using Completion = detail::Completion<R, Args...>;
+    using Value = typename Completion::Value;
+
     const std::string _ecmKey;
     const std::string _publicEndpoint;
     const std::function<R(Args...)> _func;
-    std::tuple<Args...> _argsTuple;
-    const WorkerAgent _agent;
+    WorkerAgent _agent;
 };
 
 }
@@ -0,0 +1,249 @@
+#ifndef ECUMENE_FUTURE_H
+#define ECUMENE_FUTURE_H
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace ecumene {
+
+namespace detail {
+
+// Holds a result until the continuation takes it
+template<class T>
+struct ValueSlot {
+    using Success = std::function<void(const T &)>;
+
+    std::unique_ptr<T> value;
+
+    void set(T &&v)
+    {
+        value.reset(new T(std::move(v)));
+    }
+
+    void deliver(const Success &success) const
+    {
+        success(*value);
+    }
+};
+
+// Nothing to hold but the fact of completion
+template<>
+struct ValueSlot<void> {
+    using Success = std::function<void()>;
+
+    void set()
+    {
+    }
+
+    void deliver(const Success &success) const
+    {
+        success();
+    }
+};
+
+template<class T>
+class SharedState {
+public:
+    using Success = typename ValueSlot<T>::Success;
+    using Error = std::function<void(const std::exception_ptr &)>;
+
+    template<class ... V>
+    void setValue(V &&... value)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_ready) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+        _slot.set(std::forward<V>(value)...);
+        complete(lock);
+    }
+
+    void setException(const std::exception_ptr &eptr)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_ready) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+        _eptr = eptr;
+        complete(lock);
+    }
+
+    bool ready()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _ready;
+    }
+
+    void then(Success &&success, Error &&error)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_success || _error) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        _success = std::move(success);
+        _error = std::move(error);
+        if (_ready) {
+            complete(lock);
+        }
+    }
+
+private:
+    std::mutex _mutex;
+    bool _ready = false;
+    ValueSlot<T> _slot;
+    std::exception_ptr _eptr;
+    Success _success;
+    Error _error;
+
+    // Runs the continuation, if any, outside the lock
+    void complete(std::unique_lock<std::mutex> &lock)
+    {
+        _ready = true;
+        if (!_success) {
+            return;
+        }
+
+        auto success = std::move(_success);
+        auto error = std::move(_error);
+        _success = [](const auto &...) {};
+        _error = [](const std::exception_ptr &) {};
+        lock.unlock();
+
+        if (_eptr) {
+            error(_eptr);
+        } else {
+            _slot.deliver(success);
+        }
+    }
+};
+
+}
+
+template<class T>
+class Future;
+
+namespace detail {
+
+// What Promise<T> and Promise<void> have in common
+template<class T>
+class BasicPromise {
+public:
+    BasicPromise()
+        : _owner(std::make_shared<Owner>())
+    {
+    }
+
+    void setException(const std::exception_ptr &eptr) const
+    {
+        _owner->state->setException(eptr);
+    }
+
+    Future<T> getFuture() const
+    {
+        return Future<T>(_owner->state);
+    }
+
+protected:
+    const std::shared_ptr<SharedState<T>> &state() const
+    {
+        return _owner->state;
+    }
+
+private:
+    struct Owner {
+        std::shared_ptr<SharedState<T>> state =
+            std::make_shared<SharedState<T>>();
+
+        ~Owner()
+        {
+            if (!state->ready()) {
+                state->setException(std::make_exception_ptr(
+                            std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+    };
+
+    std::shared_ptr<Owner> _owner;
+};
+
+}
+
+// Like std::promise, but copyable so it can be captured by callbacks. The
+// future is failed with broken_promise once the last copy goes away unset.
+template<class T>
+class Promise: public detail::BasicPromise<T> {
+public:
+    void setValue(T value) const
+    {
+        this->state()->setValue(std::move(value));
+    }
+};
+
+template<>
+class Promise<void>: public detail::BasicPromise<void> {
+public:
+    void setValue() const
+    {
+        state()->setValue();
+    }
+};
+
+// Like std::future, but completion is observed through a callback instead of
+// by blocking, which is what lets a worker reply without parking a thread.
+template<class T>
+class Future {
+public:
+    Future() = default;
+
+    bool valid() const
+    {
+        return static_cast<bool>(_state);
+    }
+
+    // Calls `success` or `error` exactly once, on the thread that completes
+    // the promise, or right away if it is already complete. `success` takes
+    // the value, or nothing for Future<void>.
+    template<class S, class E>
+    void then(S &&success, E &&error)
+    {
+        if (!_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+
+        auto state = std::move(_state);
+        state->then(std::forward<S>(success), std::forward<E>(error));
+    }
+
+private:
+    friend class detail::BasicPromise<T>;
+
+    explicit Future(const std::shared_ptr<detail::SharedState<T>> &state)
+        : _state(state)
+    {
+    }
+
+    std::shared_ptr<detail::SharedState<T>> _state;
+};
+
+template<class T>
+Future<typename std::decay<T>::type> makeReadyFuture(T &&value)
+{
+    Promise<typename std::decay<T>::type> p;
+    p.setValue(std::forward<T>(value));
+    return p.getFuture();
+}
+
+inline Future<void> makeReadyFuture()
+{
+    Promise<void> p;
+    p.setValue();
+    return p.getFuture();
+}
+
+}
+
+#endif /* ECUMENE_FUTURE_H */
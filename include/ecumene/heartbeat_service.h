@@ -2,9 +2,12 @@
 #define ECUMENE_HEARTBEAT_SERVICE_H
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 
+#include "ecumene/load_report.h"
+
 typedef struct _zsock_t zsock_t;
 typedef struct _zactor_t zactor_t;
 
@@ -18,13 +21,21 @@ public:
     HeartbeatService(HeartbeatService &&) = delete;
     void operator =(const HeartbeatService &) = delete;
 
+    // Heartbeats carry a load report if `load` is set
     void registerWorker(
             const std::string &ecmKey,
-            const std::string &endpoint);
+            const std::string &endpoint,
+            const std::shared_ptr<detail::LoadMonitor> &load = nullptr);
     void unregisterWorker(
             const std::string &ecmKey,
             const std::string &endpoint);
 
+    // Starts or stops (null) sending load reports for a registered worker
+    void setWorkerLoad(
+            const std::string &ecmKey,
+            const std::string &endpoint,
+            const std::shared_ptr<detail::LoadMonitor> &load);
+
 private:
     HeartbeatService();
     ~HeartbeatService();
@@ -33,8 +44,13 @@ private:
 
     std::mutex workersMutex;
 
+    struct Worker {
+        std::string endpoint;
+        std::shared_ptr<detail::LoadMonitor> load;
+    };
+
     // Alive
-    std::multimap<std::string, std::string> workers;
+    std::multimap<std::string, Worker> workers;
 
     // To be unregistered
     std::multimap<std::string, std::string> unreg;
@@ -0,0 +1,175 @@
+#ifndef ECUMENE_INLINE_FUNCTION_H
+#define ECUMENE_INLINE_FUNCTION_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ecumene {
+
+namespace detail {
+
+template<class Signature, std::size_t Capacity = 64>
+class InlineFunction;
+
+// Move-only std::function replacement that stores callables of up to
+// `Capacity` bytes in place, falling back to the heap for larger ones.
+template<class R, class ... Args, std::size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+public:
+    InlineFunction() = default;
+
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F &&f)
+    {
+        using Fn = typename std::decay<F>::type;
+        using Storage = typename std::conditional<
+            fitsInline<Fn>(), Inline<Fn>, Heap<Fn>>::type;
+
+        Storage::construct(&_storage, std::forward<F>(f));
+        _ops = &Storage::ops;
+    }
+
+    InlineFunction(InlineFunction &&other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    InlineFunction &operator =(InlineFunction &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~InlineFunction()
+    {
+        reset();
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    void operator =(const InlineFunction &) = delete;
+
+    explicit operator bool() const
+    {
+        return _ops != nullptr;
+    }
+
+    R operator ()(Args ... args) const
+    {
+        if (!_ops) {
+            throw std::bad_function_call();
+        }
+        return _ops->invoke(&_storage, std::forward<Args>(args)...);
+    }
+
+private:
+    struct Ops {
+        R (*invoke)(void *storage, Args &&... args);
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *storage);
+    };
+
+    template<class Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof (Fn) <= Capacity &&
+            alignof(Fn) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template<class Fn>
+    struct Inline {
+        template<class F>
+        static void construct(void *storage, F &&f)
+        {
+            new (storage) Fn(std::forward<F>(f));
+        }
+
+        static R invoke(void *storage, Args &&... args)
+        {
+            return (*static_cast<Fn *>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void move(void *dst, void *src)
+        {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+            destroy(src);
+        }
+
+        static void destroy(void *storage)
+        {
+            static_cast<Fn *>(storage)->~Fn();
+        }
+
+        static constexpr Ops ops = { invoke, move, destroy };
+    };
+
+    template<class Fn>
+    struct Heap {
+        template<class F>
+        static void construct(void *storage, F &&f)
+        {
+            *static_cast<Fn **>(storage) = new Fn(std::forward<F>(f));
+        }
+
+        static R invoke(void *storage, Args &&... args)
+        {
+            return (**static_cast<Fn **>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void move(void *dst, void *src)
+        {
+            *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+        }
+
+        static void destroy(void *storage)
+        {
+            delete *static_cast<Fn **>(storage);
+        }
+
+        static constexpr Ops ops = { invoke, move, destroy };
+    };
+
+    mutable typename std::aligned_storage<
+        Capacity, alignof(std::max_align_t)>::type _storage;
+    const Ops *_ops = nullptr;
+
+    void moveFrom(InlineFunction &other)
+    {
+        if (other._ops) {
+            other._ops->move(&_storage, &other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        if (_ops) {
+            _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+    }
+};
+
+template<class R, class ... Args, std::size_t Capacity>
+template<class Fn>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops
+InlineFunction<R(Args...), Capacity>::Inline<Fn>::ops;
+
+template<class R, class ... Args, std::size_t Capacity>
+template<class Fn>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops
+InlineFunction<R(Args...), Capacity>::Heap<Fn>::ops;
+
+}
+
+}
+
+#endif /* ECUMENE_INLINE_FUNCTION_H */
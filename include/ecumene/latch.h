@@ -0,0 +1,48 @@
+#ifndef ECUMENE_LATCH_H
+#define ECUMENE_LATCH_H
+
+#include <atomic>
+#include <chrono>
+
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace ecumene {
+
+namespace detail {
+
+// One-shot wakeup for a single waiting thread. Opening it costs a system
+// call only if the waiter has gone to sleep; on Linux it sleeps on a futex.
+class Latch {
+public:
+    Latch() = default;
+
+    Latch(const Latch &) = delete;
+    void operator =(const Latch &) = delete;
+
+    // Spins for up to `spin` before sleeping
+    void wait(const std::chrono::microseconds &spin);
+    void open();
+
+private:
+    enum State {
+        Closed,
+        Open,
+        Sleeping
+    };
+
+    std::atomic<int> _state{Closed};
+
+#ifndef __linux__
+    std::mutex _mutex;
+    std::condition_variable _cv;
+#endif
+};
+
+}
+
+}
+
+#endif /* ECUMENE_LATCH_H */
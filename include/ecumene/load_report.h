@@ -0,0 +1,73 @@
+#ifndef ECUMENE_LOAD_REPORT_H
+#define ECUMENE_LOAD_REPORT_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+
+typedef struct _zframe_t zframe_t;
+
+namespace ecumene {
+
+namespace detail {
+
+// How busy a worker is. Workers append one to their heartbeats, and Ecumene
+// may pass it along with the endpoints it assigns.
+struct LoadReport {
+    // Requests found waiting behind the one being served
+    std::uint32_t queueDepth = 0;
+
+    // Requests accepted but not yet answered
+    std::uint32_t inFlight = 0;
+
+    // Recent handler latencies, in microseconds
+    std::uint32_t p50 = 0;
+    std::uint32_t p99 = 0;
+
+    // Process CPU use in permille of all cores
+    std::uint16_t cpu = 0;
+
+    // Rough expected wait for a new request; lower is better
+    double score() const;
+
+    zframe_t *encode() const;
+    static LoadReport decode(zframe_t *frame);
+};
+
+// Collects the figures of one worker. Updated from any thread.
+class LoadMonitor {
+public:
+    LoadMonitor();
+
+    LoadMonitor(const LoadMonitor &) = delete;
+    void operator =(const LoadMonitor &) = delete;
+
+    void accepted(std::size_t waiting);
+    void answered(const std::chrono::steady_clock::duration &latency);
+    void released();
+
+    // Figures since the last report
+    LoadReport report();
+
+private:
+    static const std::size_t SAMPLES = 256;
+
+    std::atomic<std::uint32_t> _inFlight;
+    std::atomic<std::uint32_t> _queueDepth;
+
+    std::mutex _mutex;
+    std::array<std::uint32_t, SAMPLES> _latencies;
+    std::size_t _count;
+    std::clock_t _cpuAt;
+    std::chrono::steady_clock::time_point _reportedAt;
+};
+
+}
+
+}
+
+#endif /* ECUMENE_LOAD_REPORT_H */
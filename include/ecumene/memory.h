@@ -8,6 +8,7 @@ typedef struct _zframe_t zframe_t;
 typedef struct _zmsg_t zmsg_t;
 typedef struct _zsock_t zsock_t;
 typedef struct _zpoller_t zpoller_t;
+typedef struct _zactor_t zactor_t;
 
 namespace ecumene {
 
@@ -17,11 +18,13 @@ using FrameDel = std::function<void(zframe_t *)>;
 using MsgDel = std::function<void(zmsg_t *)>;
 using SockDel = std::function<void(zsock_t *)>;
 using PollerDel = std::function<void(zpoller_t *)>;
+using ActorDel = std::function<void(zactor_t *)>;
 
 std::unique_ptr<zframe_t, FrameDel> makeFrame(zframe_t *f);
 std::unique_ptr<zmsg_t, MsgDel> makeMsg(zmsg_t *m);
 std::unique_ptr<zsock_t, SockDel> makeSock(zsock_t *s);
 std::unique_ptr<zpoller_t, PollerDel> makePoller(zpoller_t *p);
+std::unique_ptr<zactor_t, ActorDel> makeActor(zactor_t *a);
 
 }
 
@@ -0,0 +1,59 @@
+#ifndef ECUMENE_MESSAGE_HEADER_H
+#define ECUMENE_MESSAGE_HEADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ecumene/priority.h"
+
+typedef struct _zframe_t zframe_t;
+
+namespace ecumene {
+
+namespace detail {
+
+// Optional trailing frame of requests and responses. It is only sent when
+// non-empty, so peers that predate it keep seeing the plain envelope.
+struct MessageHeader {
+    enum Flag : std::uint8_t {
+        Compressed = 1 << 0,
+        AcceptsCompression = 1 << 1,
+        Raw = 1 << 2,
+        OneWay = 1 << 3,
+        Blobs = 1 << 4,
+
+        // A call whose Upload follows in Chunk messages, the last one
+        // flagged StreamEnd
+        Streamed = 1 << 5,
+        Chunk = 1 << 6,
+        StreamEnd = 1 << 7
+    };
+
+    std::uint8_t flags = 0;
+
+    // Layout hash of a raw-encoded signature
+    std::uint64_t schema = 0;
+
+    // Keys of the functions the result goes through next, worker to worker
+    std::vector<std::string> chain;
+
+    Priority priority = Priority::Normal;
+
+    // Milliseconds the caller still waits for the result of a chain, or 0
+    std::uint32_t budget = 0;
+
+    bool empty() const;
+    bool has(Flag flag) const;
+    void set(Flag flag);
+    void clear(Flag flag);
+
+    zframe_t *encode() const;
+    static MessageHeader decode(zframe_t *frame);
+};
+
+}
+
+}
+
+#endif /* ECUMENE_MESSAGE_HEADER_H */
@@ -0,0 +1,70 @@
+#ifndef ECUMENE_PARTITION_H
+#define ECUMENE_PARTITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <msgpack.hpp>
+
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+// Calls go to whichever worker the key is connected to
+constexpr std::size_t NoPartitionKey = std::numeric_limits<std::size_t>::max();
+
+namespace detail {
+
+// Hash of packed bytes, the same in every process and build so that all
+// clients send a partition to the same worker
+std::uint64_t partitionHash(const char *data, std::size_t size);
+
+// Equal values hash alike whatever their C++ type, since MessagePack packs
+// them alike
+template<class T>
+std::uint64_t partitionHash(const T &value)
+{
+    Pooled<msgpack::sbuffer> sbuf;
+    msgpack::pack(*sbuf, value);
+    return partitionHash(sbuf->data(), sbuf->size());
+}
+
+// Hash of argument `index`
+inline std::uint64_t partitionHashOf(std::size_t)
+{
+    return 0;
+}
+
+template<class T, class ... Rest>
+std::uint64_t partitionHashOf(std::size_t index, const T &first, const Rest &... rest)
+{
+    return index == 0 ? partitionHash(first) : partitionHashOf(index - 1, rest...);
+}
+
+// Rendezvous hashing over the live workers of a key: a partition goes to the
+// worker that scores highest for it. Only partitions of a worker that leaves,
+// and those a joining worker wins, move.
+class Rendezvous {
+public:
+    // Replaces the workers, in any order
+    void assign(std::vector<std::string> &&endpoints);
+
+    bool empty() const;
+    bool contains(const std::string &endpoint) const;
+
+    // Not valid once empty
+    const std::string &pick(std::uint64_t partition) const;
+
+private:
+    std::vector<std::string> _endpoints;
+    std::vector<std::uint64_t> _seeds;
+};
+
+}
+
+}
+
+#endif /* ECUMENE_PARTITION_H */
@@ -0,0 +1,67 @@
+#ifndef ECUMENE_POOL_H
+#define ECUMENE_POOL_H
+
+#include <memory>
+
+#include <msgpack.hpp>
+
+namespace ecumene {
+
+namespace detail {
+
+// Per-thread free lists of serialization buffers and zones. Released objects
+// are reset and kept for reuse, except ones that grew past a retention limit
+// so that a single huge payload does not pin its memory.
+template<class T>
+std::unique_ptr<T> acquire();
+
+template<class T>
+void release(std::unique_ptr<T> &&object);
+
+template<>
+std::unique_ptr<msgpack::sbuffer> acquire<msgpack::sbuffer>();
+
+template<>
+void release<msgpack::sbuffer>(std::unique_ptr<msgpack::sbuffer> &&object);
+
+template<>
+std::unique_ptr<msgpack::zone> acquire<msgpack::zone>();
+
+template<>
+void release<msgpack::zone>(std::unique_ptr<msgpack::zone> &&object);
+
+template<class T>
+class Pooled {
+public:
+    Pooled()
+        : _object(acquire<T>())
+    {
+    }
+
+    ~Pooled()
+    {
+        release<T>(std::move(_object));
+    }
+
+    Pooled(const Pooled &) = delete;
+    void operator =(const Pooled &) = delete;
+
+    T &operator *() const
+    {
+        return *_object;
+    }
+
+    T *operator ->() const
+    {
+        return _object.get();
+    }
+
+private:
+    std::unique_ptr<T> _object;
+};
+
+}
+
+}
+
+#endif /* ECUMENE_POOL_H */
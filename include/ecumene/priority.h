@@ -0,0 +1,86 @@
+#ifndef ECUMENE_PRIORITY_H
+#define ECUMENE_PRIORITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+namespace ecumene {
+
+// Calls of a higher class are dispatched by the client and served by the
+// worker ahead of lower ones
+enum class Priority : std::uint8_t {
+    High,
+    Normal,
+    Low
+};
+
+namespace detail {
+
+static const std::size_t PRIORITY_CLASSES = 3;
+
+// A lower class passed over this many times in a row is served next
+static const std::size_t STARVATION_LIMIT = 16;
+
+// Serves higher classes first, but never starves lower ones for good. Not
+// thread-safe.
+template<class T>
+class PriorityQueue {
+public:
+    void push(T &&item, Priority priority)
+    {
+        _queues[static_cast<std::size_t>(priority)].push_back(std::move(item));
+        ++_size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    // Must not be empty
+    T pop()
+    {
+        std::size_t chosen = PRIORITY_CLASSES;
+        for (std::size_t c = 1; c < PRIORITY_CLASSES; ++c) {
+            if (!_queues[c].empty() && _passedOver[c] >= STARVATION_LIMIT) {
+                chosen = c;
+                break;
+            }
+        }
+        for (std::size_t c = 0; chosen == PRIORITY_CLASSES; ++c) {
+            if (!_queues[c].empty()) {
+                chosen = c;
+            }
+        }
+
+        for (std::size_t c = chosen + 1; c < PRIORITY_CLASSES; ++c) {
+            if (!_queues[c].empty()) {
+                ++_passedOver[c];
+            }
+        }
+        _passedOver[chosen] = 0;
+
+        T item = std::move(_queues[chosen].front());
+        _queues[chosen].pop_front();
+        --_size;
+        return item;
+    }
+
+private:
+    std::deque<T> _queues[PRIORITY_CLASSES];
+    std::size_t _passedOver[PRIORITY_CLASSES] = {};
+    std::size_t _size = 0;
+};
+
+}
+
+}
+
+#endif /* ECUMENE_PRIORITY_H */
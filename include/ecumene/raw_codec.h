@@ -0,0 +1,277 @@
+#ifndef ECUMENE_RAW_CODEC_H
+#define ECUMENE_RAW_CODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <msgpack.hpp>
+
+#include "ecumene/exception.h"
+
+namespace ecumene {
+
+class StringRef;
+class BytesRef;
+
+namespace detail {
+
+enum RawKind : std::uint64_t {
+    RawOther,
+    RawBool,
+    RawSigned,
+    RawUnsigned,
+    RawFloat,
+    RawEnum
+};
+
+constexpr std::uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr std::uint64_t FNV_PRIME = 1099511628211ull;
+
+constexpr std::uint64_t fnv1a(std::uint64_t hash, std::uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        hash = (hash ^ ((value >> (8 * i)) & 0xff)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+template<class T>
+constexpr std::uint64_t rawKind()
+{
+    return std::is_same<T, bool>::value ? RawBool
+        : std::is_enum<T>::value ? RawEnum
+        : std::is_floating_point<T>::value ? RawFloat
+        : std::is_integral<T>::value && std::is_signed<T>::value ? RawSigned
+        : std::is_integral<T>::value ? RawUnsigned
+        : RawOther;
+}
+
+}
+
+// Identity of a raw-encoded type. Arithmetic and enum types have one built
+// in. Other types are only raw-encoded once specialized with a value of
+// their own, since their layout alone can't tell them apart:
+//
+//     template<>
+//     struct RawSchema<Vec3> {
+//         static constexpr std::uint64_t value = rawSchemaName("myapp.Vec3");
+//     };
+template<class T, class Enable = void>
+struct RawSchema {};
+
+template<class T>
+struct RawSchema<T, typename std::enable_if<detail::rawKind<T>() != detail::RawOther>::type> {
+    static constexpr std::uint64_t value = detail::fnv1a(
+            detail::fnv1a(detail::FNV_OFFSET, alignof(T)),
+            detail::rawKind<T>());
+};
+
+constexpr std::uint64_t rawSchemaName(const char *name)
+{
+    std::uint64_t hash = detail::FNV_OFFSET;
+    for (; *name; ++name) {
+        hash = (hash ^ static_cast<unsigned char>(*name)) * detail::FNV_PRIME;
+    }
+    return hash;
+}
+
+namespace detail {
+
+template<class T, class = void>
+struct HasRawSchema: std::false_type {};
+
+template<class T>
+struct HasRawSchema<T, decltype(void(RawSchema<T>::value))>: std::true_type {};
+
+template<class T>
+struct IsRaw: std::integral_constant<bool,
+    std::is_trivially_copyable<T>::value &&
+    !std::is_pointer<T>::value &&
+    !std::is_member_pointer<T>::value &&
+    HasRawSchema<T>::value> {};
+
+// Trivially copyable, but point into the message they were decoded from
+template<>
+struct IsRaw<StringRef>: std::false_type {};
+
+template<>
+struct IsRaw<BytesRef>: std::false_type {};
+
+template<class ... Types>
+struct AllRaw: std::true_type {};
+
+template<class T, class ... Types>
+struct AllRaw<T, Types...>:
+    std::integral_constant<bool, IsRaw<T>::value && AllRaw<Types...>::value> {};
+
+
+// First byte of raw payloads. 0xc1 is never used by MessagePack, so a peer
+// without raw support fails to unpack instead of misreading the arguments.
+constexpr char RAW_MARKER = static_cast<char>(0xc1);
+
+template<class R, class ... Args>
+constexpr std::uint64_t rawSchema()
+{
+    // Sizes too, in case a type changed but kept its name
+    const std::uint64_t parts[] = {
+        fnv1a(RawSchema<R>::value, sizeof (R)),
+        fnv1a(RawSchema<Args>::value, sizeof (Args))...
+    };
+
+    std::uint64_t hash = FNV_OFFSET;
+#if defined(__BYTE_ORDER__)
+    hash = fnv1a(hash, __BYTE_ORDER__);
+#endif
+    for (std::size_t i = 0; i < sizeof (parts) / sizeof (parts[0]); ++i) {
+        hash = fnv1a(hash, parts[i]);
+    }
+
+    // Zero means "no schema" in the message header
+    return hash != 0 ? hash : 1;
+}
+
+template<class ... Types>
+constexpr std::size_t rawSizeOf()
+{
+    const std::size_t sizes[] = { 0, sizeof (Types)... };
+
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); ++i) {
+        size += sizes[i];
+    }
+    return size;
+}
+
+// Where the value at `index` starts, after the marker byte
+template<class ... Types>
+constexpr std::size_t rawOffsetOf(std::size_t index)
+{
+    const std::size_t sizes[] = { sizeof (Types)..., 0 };
+
+    std::size_t offset = 1;
+    for (std::size_t i = 0; i < index; ++i) {
+        offset += sizes[i];
+    }
+    return offset;
+}
+
+// Copies the bytes into a value without needing a default constructor
+template<class T>
+T readRaw(const char *data)
+{
+    typename std::aligned_storage<sizeof (T), alignof(T)>::type storage;
+    std::memcpy(&storage, data, sizeof (T));
+    return *reinterpret_cast<const T *>(&storage);
+}
+
+// Fixed binary layout for signatures whose types are all trivially copyable:
+// a marker byte followed by each value's bytes, back to back.
+template<bool Enabled, class R, class ... Args>
+struct RawCodec {
+    static constexpr std::uint64_t schema = rawSchema<R, Args...>();
+
+    static void packArgs(msgpack::sbuffer &sbuf, const Args &... args)
+    {
+        sbuf.write(&RAW_MARKER, 1);
+        const int expand[] = {
+            0,
+            (sbuf.write(reinterpret_cast<const char *>(&args), sizeof (Args)), 0)...
+        };
+        (void)expand;
+    }
+
+    static std::tuple<Args...> unpackArgs(
+            std::uint64_t peerSchema,
+            const char *data,
+            std::size_t size)
+    {
+        check(peerSchema, data, size, rawSizeOf<Args...>());
+        return readArgs(data, std::index_sequence_for<Args...>());
+    }
+
+    static void packResult(msgpack::sbuffer &sbuf, const R &result)
+    {
+        sbuf.write(&RAW_MARKER, 1);
+        sbuf.write(reinterpret_cast<const char *>(&result), sizeof (R));
+    }
+
+    static R unpackResult(const char *data, std::size_t size)
+    {
+        check(schema, data, size, sizeof (R));
+        return readRaw<R>(data + 1);
+    }
+
+private:
+    template<std::size_t ... Indices>
+    static std::tuple<Args...> readArgs(const char *data, std::index_sequence<Indices...>)
+    {
+        return std::tuple<Args...>(readRaw<Args>(data + rawOffsetOf<Args...>(Indices))...);
+    }
+
+    static void check(
+            std::uint64_t peerSchema,
+            const char *data,
+            std::size_t size,
+            std::size_t expectedSize)
+    {
+        if (peerSchema != schema) {
+            throw InvalidArgument("raw schema mismatch");
+        }
+        if (size != expectedSize + 1 || data[0] != RAW_MARKER) {
+            throw InvalidArgument("malformed raw payload");
+        }
+    }
+};
+
+template<class R, class ... Args>
+struct RawCodec<false, R, Args...> {
+    static constexpr std::uint64_t schema = 0;
+
+    static void packArgs(msgpack::sbuffer &, const Args &...)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+
+    static std::tuple<Args...> unpackArgs(std::uint64_t, const char *, std::size_t)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+
+    static void packResult(msgpack::sbuffer &, const R &)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+
+    static R unpackResult(const char *, std::size_t)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+};
+
+// Nothing to encode for void results, and void signatures are never raw
+template<class ... Args>
+struct RawCodec<false, void, Args...> {
+    static constexpr std::uint64_t schema = 0;
+
+    static void packArgs(msgpack::sbuffer &, const Args &...)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+
+    static std::tuple<Args...> unpackArgs(std::uint64_t, const char *, std::size_t)
+    {
+        throw InvalidArgument("signature cannot be raw-encoded");
+    }
+};
+
+template<class R, class ... Args>
+using RawCodecFor = RawCodec<AllRaw<R, Args...>::value, R, Args...>;
+
+}
+
+}
+
+#endif /* ECUMENE_RAW_CODEC_H */
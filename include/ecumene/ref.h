@@ -0,0 +1,168 @@
+#ifndef ECUMENE_REF_H
+#define ECUMENE_REF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <msgpack.hpp>
+
+namespace ecumene {
+
+// A string argument left where it arrived, in the request frame. Only valid
+// until the handler returns; copy anything kept longer.
+class StringRef {
+public:
+    StringRef()
+        : _data(nullptr)
+        , _size(0)
+    {
+    }
+
+    StringRef(const char *data, std::size_t size)
+        : _data(data)
+        , _size(size)
+    {
+    }
+
+    StringRef(const std::string &s)
+        : _data(s.data())
+        , _size(s.size())
+    {
+    }
+
+    const char *data() const
+    {
+        return _data;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    std::string str() const
+    {
+        return std::string(_data, _size);
+    }
+
+private:
+    const char *_data;
+    std::size_t _size;
+};
+
+// Same, for binary arguments
+class BytesRef {
+public:
+    BytesRef()
+        : _data(nullptr)
+        , _size(0)
+    {
+    }
+
+    BytesRef(const char *data, std::size_t size)
+        : _data(data)
+        , _size(size)
+    {
+    }
+
+    const char *data() const
+    {
+        return _data;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+private:
+    const char *_data;
+    std::size_t _size;
+};
+
+}
+
+namespace msgpack {
+
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+
+namespace adaptor {
+
+template<>
+struct convert<ecumene::StringRef> {
+    const msgpack::object &operator ()(
+            const msgpack::object &o,
+            ecumene::StringRef &v) const
+    {
+        if (o.type == msgpack::type::STR) {
+            v = ecumene::StringRef(o.via.str.ptr, o.via.str.size);
+        } else if (o.type == msgpack::type::BIN) {
+            v = ecumene::StringRef(o.via.bin.ptr, o.via.bin.size);
+        } else {
+            throw msgpack::type_error();
+        }
+        return o;
+    }
+};
+
+template<>
+struct pack<ecumene::StringRef> {
+    template<class Stream>
+    msgpack::packer<Stream> &operator ()(
+            msgpack::packer<Stream> &o,
+            const ecumene::StringRef &v) const
+    {
+        o.pack_str(static_cast<std::uint32_t>(v.size()));
+        o.pack_str_body(v.data(), static_cast<std::uint32_t>(v.size()));
+        return o;
+    }
+};
+
+template<>
+struct convert<ecumene::BytesRef> {
+    const msgpack::object &operator ()(
+            const msgpack::object &o,
+            ecumene::BytesRef &v) const
+    {
+        if (o.type == msgpack::type::BIN) {
+            v = ecumene::BytesRef(o.via.bin.ptr, o.via.bin.size);
+        } else if (o.type == msgpack::type::STR) {
+            v = ecumene::BytesRef(o.via.str.ptr, o.via.str.size);
+        } else {
+            throw msgpack::type_error();
+        }
+        return o;
+    }
+};
+
+template<>
+struct pack<ecumene::BytesRef> {
+    template<class Stream>
+    msgpack::packer<Stream> &operator ()(
+            msgpack::packer<Stream> &o,
+            const ecumene::BytesRef &v) const
+    {
+        o.pack_bin(static_cast<std::uint32_t>(v.size()));
+        o.pack_bin_body(v.data(), static_cast<std::uint32_t>(v.size()));
+        return o;
+    }
+};
+
+}
+
+}
+
+}
+
+#endif /* ECUMENE_REF_H */
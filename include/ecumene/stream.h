@@ -0,0 +1,250 @@
+#ifndef ECUMENE_STREAM_H
+#define ECUMENE_STREAM_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <msgpack.hpp>
+
+#include "ecumene/decoder.h"
+#include "ecumene/exception.h"
+#include "ecumene/future.h"
+
+typedef struct _zframe_t zframe_t;
+
+namespace ecumene {
+
+// Chunks an Upload is cut into by default, and how many of them may be on
+// their way to the worker at once
+constexpr std::size_t DefaultChunkSize = 1 << 20;
+constexpr std::size_t DefaultUploadWindow = 8;
+
+namespace detail {
+
+// Stands in for the streamed argument in the packed arguments
+static const std::int8_t STREAM_EXT = 's';
+
+// Produces the chunks of an upload on the client's network thread
+class UploadSource {
+public:
+    virtual ~UploadSource() = default;
+
+    // Next chunk, or null after the last
+    virtual zframe_t *next() = 0;
+};
+
+class StreamState;
+
+}
+
+// A call argument sent after the call itself, as a sequence of chunks the
+// worker acknowledges as it consumes them. The worker takes it as a
+// ChunkStream. At most one per call.
+class Upload {
+public:
+    // Chunks are produced on the network thread, so `next` should be quick.
+    // It returns false once there are none left.
+    explicit Upload(std::function<bool(std::string &chunk)> &&next);
+
+    // Each element is one chunk
+    template<class It>
+    Upload(It begin, It end)
+        : Upload([begin, end](std::string &chunk) mutable {
+            if (begin == end) {
+                return false;
+            }
+            chunk = *begin;
+            ++begin;
+            return true;
+        })
+    {
+    }
+
+    // Sends the file straight from a read-only mapping. Throws
+    // std::runtime_error if it can't be mapped.
+    static Upload fromFile(
+            const std::string &path,
+            std::size_t chunkSize = DefaultChunkSize);
+
+private:
+    friend std::shared_ptr<detail::UploadSource> uploadSource(const Upload &upload);
+
+    explicit Upload(const std::shared_ptr<detail::UploadSource> &source);
+
+    std::shared_ptr<detail::UploadSource> _source;
+};
+
+// The worker's end of an Upload
+class ChunkStream {
+public:
+    // Calls `chunk` with each chunk in order, then `end` after the last, or
+    // `error` if the client aborts the upload or stops sending. All run on
+    // the worker thread. Call it from the handler, which must return a
+    // Future and complete it once done.
+    void read(
+            std::function<void(const char *data, std::size_t size)> &&chunk,
+            std::function<void()> &&end,
+            std::function<void(const std::exception_ptr &)> &&error) const;
+
+private:
+    friend struct detail::Decode<ChunkStream>;
+    friend struct msgpack::adaptor::convert<ChunkStream>;
+
+    std::shared_ptr<detail::StreamState> _state;
+};
+
+std::shared_ptr<detail::UploadSource> uploadSource(const Upload &upload);
+
+namespace detail {
+
+// Chunks received for a streamed request, until its handler reads them.
+// Each chunk read is acknowledged with `grant`, which lets the client send
+// another. Only used on the worker thread.
+class StreamState {
+public:
+    using Chunk = std::function<void(const char *, std::size_t)>;
+    using End = std::function<void()>;
+    using Error = std::function<void(const std::exception_ptr &)>;
+
+    explicit StreamState(std::function<void(std::size_t)> &&grant);
+    ~StreamState();
+
+    StreamState(const StreamState &) = delete;
+    void operator =(const StreamState &) = delete;
+
+    // Takes ownership of the frame
+    void push(zframe_t *chunk);
+    void finish();
+
+    // Drops what is buffered and fails the reader, now or once it reads
+    void fail(const std::exception_ptr &eptr);
+
+    void read(Chunk &&chunk, End &&end, Error &&error);
+
+    std::chrono::steady_clock::time_point lastActive() const;
+
+private:
+    std::function<void(std::size_t)> _grant;
+    std::deque<zframe_t *> _buffered;
+    bool _finished = false;
+    bool _reading = false;
+    Chunk _chunk;
+    End _end;
+    Error _error;
+    std::exception_ptr _eptr;
+    std::chrono::steady_clock::time_point _lastActive;
+
+    void deliver();
+};
+
+// Stream of the request being decoded on this thread, if any. Taken by the
+// first ChunkStream argument.
+void setCurrentStream(const std::shared_ptr<StreamState> &state);
+std::shared_ptr<StreamState> takeCurrentStream();
+
+std::shared_ptr<StreamState> streamFrom(std::int8_t type, std::size_t size);
+
+template<>
+struct Decode<ChunkStream> {
+    static ChunkStream read(Reader &reader, msgpack::zone &)
+    {
+        std::int8_t type;
+        const StringRef body = reader.readExt(type);
+
+        ChunkStream stream;
+        stream._state = streamFrom(type, body.size());
+        return stream;
+    }
+};
+
+template<class T>
+struct IsUpload: std::is_same<typename std::decay<T>::type, Upload> {};
+
+template<class T>
+struct IsChunkStream: std::is_same<typename std::decay<T>::type, ChunkStream> {};
+
+template<template<class> class P, class ... Types>
+struct AnyOf: std::false_type {};
+
+template<template<class> class P, class T, class ... Types>
+struct AnyOf<P, T, Types...>:
+    std::integral_constant<bool, P<T>::value || AnyOf<P, Types...>::value> {};
+
+template<class T>
+struct IsFuture: std::false_type {};
+
+template<class T>
+struct IsFuture<Future<T>>: std::true_type {};
+
+inline std::shared_ptr<UploadSource> findUploadIn(const Upload &upload)
+{
+    return uploadSource(upload);
+}
+
+template<class T>
+std::shared_ptr<UploadSource> findUploadIn(const T &)
+{
+    return nullptr;
+}
+
+// Source of the Upload among the arguments, if any
+template<class ... Args>
+std::shared_ptr<UploadSource> findUpload(const Args &... args)
+{
+    std::shared_ptr<UploadSource> found;
+    const int unused[] = { 0, (found = found ? found : findUploadIn(args), 0)... };
+    (void)unused;
+    return found;
+}
+
+}
+
+}
+
+namespace msgpack {
+
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+
+namespace adaptor {
+
+template<>
+struct pack<ecumene::Upload> {
+    template<class Stream>
+    msgpack::packer<Stream> &operator ()(
+            msgpack::packer<Stream> &o,
+            const ecumene::Upload &) const
+    {
+        o.pack_ext(0, ecumene::detail::STREAM_EXT);
+        return o;
+    }
+};
+
+template<>
+struct convert<ecumene::ChunkStream> {
+    const msgpack::object &operator ()(
+            const msgpack::object &o,
+            ecumene::ChunkStream &v) const
+    {
+        if (o.type != msgpack::type::EXT) {
+            throw msgpack::type_error();
+        }
+        v._state = ecumene::detail::streamFrom(o.via.ext.type(), o.via.ext.size);
+        return o;
+    }
+};
+
+}
+
+}
+
+}
+
+#endif /* ECUMENE_STREAM_H */
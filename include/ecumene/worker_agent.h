@@ -1,34 +1,87 @@
 #ifndef ECUMENE_WORKER_AGENT_H
 #define ECUMENE_WORKER_AGENT_H
 
+#include <chrono>
+#include <cstddef>
+#include <exception>
 #include <functional>
+#include <memory>
 #include <string>
 
 #include <msgpack.hpp>
 
+#include "ecumene/load_report.h"
+#include "ecumene/message_header.h"
+
 typedef struct _zsock_t zsock_t;
 typedef struct _zactor_t zactor_t;
 
 namespace ecumene {
 
+namespace detail {
+
+struct WorkerOutbox;
+struct PendingReply;
+
+}
+
+// Answers one request, from any thread. Copies refer to the same request;
+// only the first answer is sent, and a request that is never answered fails
+// with an unknown error once the last copy is gone. For requests that are
+// part of a chain, a result is passed on to the next function instead.
+class WorkerReply {
+public:
+    void succeed(
+            const msgpack::sbuffer &sbuf,
+            detail::MessageHeader header = detail::MessageHeader()) const;
+    void fail(const std::exception_ptr &eptr) const;
+
+private:
+    friend class WorkerAgent;
+
+    explicit WorkerReply(const std::shared_ptr<detail::PendingReply> &pending);
+
+    void forward(const msgpack::sbuffer &sbuf) const;
+
+    std::shared_ptr<detail::PendingReply> _pending;
+};
+
+using WorkerCallback = std::function<void(
+        const char *data,
+        std::size_t size,
+        const detail::MessageHeader &requestHeader,
+        const WorkerReply &reply)>;
+
+// Called on the worker thread after every request and whenever the time it
+// last returned has passed; a negative duration means no deadline.
+using WorkerTick = std::function<std::chrono::milliseconds()>;
+
 class WorkerAgent {
 public:
     explicit WorkerAgent(
             const std::string &ecmKey,
             const std::string &localEndpoint,
             const std::string &publicEndpoint,
-            const std::function<void(const msgpack::unpacked &, msgpack::sbuffer &)> callback);
+            const WorkerCallback callback,
+            const WorkerTick tick = WorkerTick());
     ~WorkerAgent();
 
     WorkerAgent(const WorkerAgent &) = delete;
     WorkerAgent(WorkerAgent &&) = delete;
     WorkerAgent & operator =(const WorkerAgent &) = delete;
 
+    void setCompressionThreshold(std::size_t threshold);
+
+    // For heartbeats
+    std::shared_ptr<detail::LoadMonitor> load() const;
+
 private:
     const std::string _ecmKey;
     const std::string _localEndpoint;
     const std::string _publicEndpoint;
-    const std::function<void(const msgpack::unpacked &, msgpack::sbuffer &)> _callback;
+    const WorkerCallback _callback;
+    const WorkerTick _tick;
+    const std::shared_ptr<detail::WorkerOutbox> _outbox;
     zactor_t *_actor;
 
     static void actorTask(zsock_t *pipe, void *args);
@@ -1,22 +1,51 @@
 #include "ecumene/base_function.h"
+#include "ecumene/client_agent.h"
 #include "ecumene/exception.h"
+#include "ecumene/stream.h"
 
 namespace ecumene {
 
 BaseFunction::BaseFunction(const std::string &ecmKey)
     : _ecmKey(ecmKey)
+    , _keyId(detail::internEcmKey(ecmKey))
     , _timeout(std::chrono::seconds(15))
+    , _compressionThreshold(NoCompression)
+    , _idempotent(false)
+    , _blobThreshold(NoBlobs)
+    , _spin(0)
+    , _priority(Priority::Normal)
+    , _uploadWindow(DefaultUploadWindow)
+    , _partitionKey(NoPartitionKey)
 {
 }
 
 BaseFunction::BaseFunction(const BaseFunction &other)
     : BaseFunction(other._ecmKey)
 {
+    _timeout = other._timeout;
+    _compressionThreshold = other._compressionThreshold;
+    _idempotent = other._idempotent;
+    _blobThreshold = other._blobThreshold;
+    _spin = other._spin;
+    _priority = other._priority;
+    _uploadWindow = other._uploadWindow;
+    _partitionKey = other._partitionKey;
+    _chain = other._chain;
 }
 
 void BaseFunction::operator =(const BaseFunction &rhs)
 {
     _ecmKey = rhs._ecmKey;
+    _keyId = rhs._keyId;
+    _timeout = rhs._timeout;
+    _compressionThreshold = rhs._compressionThreshold;
+    _idempotent = rhs._idempotent;
+    _blobThreshold = rhs._blobThreshold;
+    _spin = rhs._spin;
+    _priority = rhs._priority;
+    _uploadWindow = rhs._uploadWindow;
+    _partitionKey = rhs._partitionKey;
+    _chain = rhs._chain;
 }
 
 void BaseFunction::setTimeout(const std::chrono::seconds &timeout)
@@ -24,6 +53,41 @@ void BaseFunction::setTimeout(const std::chrono::seconds &timeout)
     _timeout = timeout;
 }
 
+void BaseFunction::setCompressionThreshold(std::size_t threshold)
+{
+    _compressionThreshold = threshold;
+}
+
+void BaseFunction::setIdempotent(bool idempotent)
+{
+    _idempotent = idempotent;
+}
+
+void BaseFunction::setBlobThreshold(std::size_t threshold)
+{
+    _blobThreshold = threshold;
+}
+
+void BaseFunction::setUploadWindow(std::size_t chunks)
+{
+    _uploadWindow = chunks > 0 ? chunks : 1;
+}
+
+void BaseFunction::setPriority(Priority priority)
+{
+    _priority = priority;
+}
+
+void BaseFunction::setSpin(const std::chrono::microseconds &spin)
+{
+    _spin = spin;
+}
+
+void BaseFunction::prefetch() const
+{
+    ClientAgent::sharedInstance().prefetch({ _ecmKey });
+}
+
 std::exception_ptr BaseFunction::handleError(const FunctionCallResult &result) const
 {
     switch (result.status()) {
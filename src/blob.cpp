@@ -0,0 +1,191 @@
+#include <czmq.h>
+
+#include "ecumene/blob.h"
+
+namespace ecumene {
+
+void setBlobCacheCapacity(std::size_t bytes)
+{
+    detail::BlobCache::sharedInstance().setCapacity(bytes);
+}
+
+namespace detail {
+
+static const std::size_t DEFAULT_CACHE_CAPACITY = 256 << 20;
+
+std::string digestOf(const char *data, std::size_t size)
+{
+    zdigest_t *digest = zdigest_new();
+    assert(digest);
+
+    zdigest_update(digest, reinterpret_cast<const byte *>(data), size);
+    std::string result(
+            reinterpret_cast<const char *>(zdigest_data(digest)),
+            zdigest_size(digest));
+
+    zdigest_destroy(&digest);
+    return result;
+}
+
+void packReference(
+        msgpack::sbuffer &refs,
+        BlobArguments &blobs,
+        const std::string &digest,
+        const std::shared_ptr<const msgpack::sbuffer> &packed)
+{
+    assert(digest.size() == BLOB_DIGEST_SIZE);
+
+    const std::size_t offset = refs.size();
+    msgpack::packer<msgpack::sbuffer> pk(refs);
+    pk.pack_ext(BLOB_DIGEST_SIZE, BLOB_REF);
+    pk.pack_ext_body(digest.data(), BLOB_DIGEST_SIZE);
+
+    blobs.push_back(BlobArgument { offset, refs.size() - offset, packed });
+}
+
+void inlineBlobs(
+        const char *refs,
+        std::size_t size,
+        const BlobArguments &blobs,
+        bool asExtensions,
+        msgpack::sbuffer &full)
+{
+    msgpack::packer<msgpack::sbuffer> pk(full);
+
+    std::size_t offset = 0;
+    for (const auto &blob: blobs) {
+        full.write(refs + offset, blob.offset - offset);
+        if (asExtensions) {
+            pk.pack_ext(blob.packed->size(), BLOB_DATA);
+            pk.pack_ext_body(
+                    blob.packed->data(),
+                    static_cast<std::uint32_t>(blob.packed->size()));
+        } else {
+            full.write(blob.packed->data(), blob.packed->size());
+        }
+        offset = blob.offset + blob.length;
+    }
+    full.write(refs + offset, size - offset);
+}
+
+BlobCache &BlobCache::sharedInstance()
+{
+    static BlobCache sharedInstance;
+    return sharedInstance;
+}
+
+BlobCache::BlobCache()
+    : _capacity(DEFAULT_CACHE_CAPACITY)
+    , _size(0)
+{
+}
+
+void BlobCache::setCapacity(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = bytes;
+
+    while (_size > _capacity && !_entries.empty()) {
+        _size -= _entries.back().second->size;
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+std::shared_ptr<const Blob> BlobCache::find(const std::string &digest)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto it = _index.find(digest);
+    if (it == _index.cend()) {
+        return nullptr;
+    }
+
+    // Most recently used first
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->second;
+}
+
+std::shared_ptr<const Blob> BlobCache::insert(
+        const std::string &digest,
+        const char *data,
+        std::size_t size)
+{
+    auto blob = std::make_shared<Blob>();
+    blob->zone.reset(new msgpack::zone());
+    blob->object = msgpack::unpack(*blob->zone, data, size);
+    blob->size = size;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto it = _index.find(digest);
+    if (it != _index.cend()) {
+        _size -= it->second->second->size;
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+
+    _entries.emplace_front(digest, blob);
+    _index[digest] = _entries.begin();
+    _size += size;
+
+    // Never evicts the blob just inserted
+    while (_size > _capacity && _entries.size() > 1) {
+        _size -= _entries.back().second->size;
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+
+    return blob;
+}
+
+void resolveBlobs(
+        const msgpack::object &args,
+        std::vector<std::shared_ptr<const Blob>> &hold)
+{
+    if (args.type != msgpack::type::ARRAY) {
+        throw msgpack::type_error();
+    }
+
+    bool missing = false;
+    for (std::uint32_t i = 0; i < args.via.array.size; ++i) {
+        msgpack::object &arg = args.via.array.ptr[i];
+        if (arg.type != msgpack::type::EXT) {
+            continue;
+        }
+
+        std::shared_ptr<const Blob> blob;
+        if (arg.via.ext.type() == BLOB_REF) {
+            if (arg.via.ext.size != BLOB_DIGEST_SIZE) {
+                throw msgpack::type_error();
+            }
+            blob = BlobCache::sharedInstance().find(
+                    std::string(arg.via.ext.data(), BLOB_DIGEST_SIZE));
+        } else if (arg.via.ext.type() == BLOB_DATA) {
+            // Keyed by what we hash ourselves, not by what the caller claims
+            blob = BlobCache::sharedInstance().insert(
+                    digestOf(arg.via.ext.data(), arg.via.ext.size),
+                    arg.via.ext.data(),
+                    arg.via.ext.size);
+        } else {
+            continue;
+        }
+
+        if (!blob) {
+            // Keep going so the inline ones still get cached
+            missing = true;
+            continue;
+        }
+
+        arg = blob->object;
+        hold.push_back(std::move(blob));
+    }
+
+    if (missing) {
+        throw BlobMissing();
+    }
+}
+
+}
+
+}
@@ -0,0 +1,49 @@
+#include "ecumene/broadcast.h"
+
+namespace ecumene {
+
+namespace detail {
+
+Broadcast::Broadcast(const Handler &handler, const Done &done)
+    : _handler(handler)
+    , _done(done)
+    , _received(0)
+    , _answered(0)
+    , _finished(false)
+{
+}
+
+void Broadcast::receive(const FunctionCallResult &result)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _handler(result);
+    ++_received;
+    settle(lock);
+}
+
+void Broadcast::finish(std::size_t answered)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _answered = answered;
+    _finished = true;
+    settle(lock);
+}
+
+void Broadcast::settle(std::unique_lock<std::mutex> &lock)
+{
+    if (!_finished || _received < _answered) {
+        return;
+    }
+
+    // Only once
+    _finished = false;
+    lock.unlock();
+
+    _done();
+}
+
+}
+
+}
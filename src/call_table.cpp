@@ -0,0 +1,176 @@
+#include "ecumene/call_table.h"
+
+namespace ecumene {
+
+namespace detail {
+
+static std::uint32_t slotIndex(CallTable::Id id)
+{
+    return static_cast<std::uint32_t>(id);
+}
+
+static std::uint32_t slotGeneration(CallTable::Id id)
+{
+    return static_cast<std::uint32_t>(id >> 32);
+}
+
+CallTable::~CallTable()
+{
+    for (auto &chunk: _chunks) {
+        for (std::size_t i = 0; i < CHUNK_SIZE; ++i) {
+            if (chunk[i].used) {
+                chunk[i].call()->~FunctionCall();
+            }
+        }
+    }
+}
+
+CallTable::Id CallTable::insert(FunctionCall &&call)
+{
+    if (_free.empty()) {
+        const auto base = static_cast<std::uint32_t>(_chunks.size() * CHUNK_SIZE);
+        _chunks.emplace_back(new Slot[CHUNK_SIZE]);
+        for (std::size_t i = CHUNK_SIZE; i > 0; --i) {
+            _free.push_back(base + static_cast<std::uint32_t>(i - 1));
+        }
+    }
+
+    const std::uint32_t i = _free.back();
+    _free.pop_back();
+
+    Slot &s = at(i);
+
+    // Generation 0 is never used, so no valid ID is 0
+    if (++s.generation == 0) {
+        s.generation = 1;
+    }
+
+    const auto timeoutAt = call.timeoutAt;
+    new (&s.storage) FunctionCall(std::move(call));
+    s.used = true;
+    ++_size;
+
+    _deadlines.emplace_back();
+    place(_deadlines.size() - 1, std::make_pair(timeoutAt, i));
+    siftUp(_deadlines.size() - 1);
+
+    return (static_cast<Id>(s.generation) << 32) | i;
+}
+
+CallTable::Slot *CallTable::slot(Id id)
+{
+    const std::uint32_t i = slotIndex(id);
+    if (i / CHUNK_SIZE >= _chunks.size()) {
+        return nullptr;
+    }
+
+    Slot &s = at(i);
+    if (!s.used || s.generation != slotGeneration(id)) {
+        return nullptr;
+    }
+    return &s;
+}
+
+FunctionCall *CallTable::find(Id id)
+{
+    Slot *s = slot(id);
+    return s ? s->call() : nullptr;
+}
+
+void CallTable::erase(Id id)
+{
+    Slot *s = slot(id);
+    if (!s) {
+        return;
+    }
+
+    if (s->deadline != NO_DEADLINE) {
+        removeDeadline(s->deadline);
+    }
+
+    s->call()->~FunctionCall();
+    s->used = false;
+    --_size;
+    _free.push_back(slotIndex(id));
+}
+
+CallTable::Id CallTable::nextExpired(const std::chrono::steady_clock::time_point &now)
+{
+    if (_deadlines.empty() || _deadlines.front().first > now) {
+        return 0;
+    }
+
+    const std::uint32_t i = _deadlines.front().second;
+    removeDeadline(0);
+    return (static_cast<Id>(at(i).generation) << 32) | i;
+}
+
+CallTable::Slot &CallTable::at(std::uint32_t index)
+{
+    return _chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+}
+
+void CallTable::place(std::size_t position, const Deadline &deadline)
+{
+    _deadlines[position] = deadline;
+    at(deadline.second).deadline = static_cast<std::uint32_t>(position);
+}
+
+void CallTable::siftUp(std::size_t position)
+{
+    const Deadline deadline = _deadlines[position];
+    while (position > 0) {
+        const std::size_t parent = (position - 1) / 2;
+        if (!(deadline < _deadlines[parent])) {
+            break;
+        }
+        place(position, _deadlines[parent]);
+        position = parent;
+    }
+    place(position, deadline);
+}
+
+void CallTable::siftDown(std::size_t position)
+{
+    const Deadline deadline = _deadlines[position];
+    for (;;) {
+        std::size_t child = 2 * position + 1;
+        if (child >= _deadlines.size()) {
+            break;
+        }
+        if (child + 1 < _deadlines.size() && _deadlines[child + 1] < _deadlines[child]) {
+            ++child;
+        }
+        if (!(_deadlines[child] < deadline)) {
+            break;
+        }
+        place(position, _deadlines[child]);
+        position = child;
+    }
+    place(position, deadline);
+}
+
+void CallTable::removeDeadline(std::size_t position)
+{
+    at(_deadlines[position].second).deadline = NO_DEADLINE;
+
+    const Deadline last = _deadlines.back();
+    _deadlines.pop_back();
+    if (position == _deadlines.size()) {
+        return;
+    }
+
+    // The last entry takes its place and moves whichever way it must
+    place(position, last);
+    siftUp(position);
+    siftDown(at(last.second).deadline);
+}
+
+std::size_t CallTable::size() const
+{
+    return _size;
+}
+
+}
+
+}
@@ -0,0 +1,209 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <czmq.h>
+
+#include "ecumene/capture.h"
+#include "ecumene/ecm_key.h"
+#include "ecumene/message_header.h"
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+namespace detail {
+
+static const std::size_t CAPTURE_BUFFER_SIZE = 1 << 20;
+
+static void putLittleEndian(char *p, std::uint64_t value, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        p[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+static std::uint64_t getLittleEndian(const char *p, std::size_t n)
+{
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return value;
+}
+
+static std::size_t padded(std::size_t size)
+{
+    return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+CaptureWriter::CaptureWriter(const std::string &path)
+    : _file(std::fopen(path.c_str(), "ab"))
+{
+    if (!_file) {
+        return;
+    }
+
+    std::setvbuf(_file, nullptr, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    std::fseek(_file, 0, SEEK_END);
+    if (std::ftell(_file) == 0) {
+        std::fwrite(CAPTURE_MAGIC, 1, sizeof CAPTURE_MAGIC, _file);
+    }
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    if (_file) {
+        std::fclose(_file);
+    }
+}
+
+bool CaptureWriter::ok() const
+{
+    return _file != nullptr;
+}
+
+void CaptureWriter::write(const FunctionCall &call, const FunctionCallResult &result)
+{
+    const auto steadyNow = std::chrono::steady_clock::now();
+    const auto latency = steadyNow - call.startedAt;
+    const auto startedAt = std::chrono::system_clock::now().time_since_epoch() - latency;
+
+    const std::string &key = ecmKeyName(call.ecmKey);
+
+    // Replays go to workers that have never seen the blobs, so they are
+    // recorded inline as plain arguments
+    zframe_t *args = call.args;
+    zframe_t *plain = nullptr;
+    zframe_t *header = nullptr;
+    if (!call.blobs.empty() && call.args) {
+        Pooled<msgpack::sbuffer> full;
+        inlineBlobs(
+                reinterpret_cast<const char *>(zframe_data(call.args)),
+                zframe_size(call.args),
+                call.blobs,
+                false,
+                *full);
+        plain = zframe_new(full->data(), full->size());
+        args = plain;
+    }
+    if (!call.blobs.empty() && call.header) {
+        MessageHeader decoded = MessageHeader::decode(call.header);
+        decoded.clear(MessageHeader::Blobs);
+        header = decoded.encode();
+    }
+    zframe_t *headerFrame = header ? header : call.header;
+
+    const std::size_t argsSize = args ? zframe_size(args) : 0;
+    const std::size_t headerSize = headerFrame ? zframe_size(headerFrame) : 0;
+    const std::size_t bodySize = key.size() + argsSize + headerSize;
+    const std::size_t size = padded(CAPTURE_RECORD_HEADER + bodySize);
+
+    char fixed[CAPTURE_RECORD_HEADER] = {};
+    putLittleEndian(fixed, size, 4);
+    putLittleEndian(fixed + 4, key.size(), 4);
+    putLittleEndian(fixed + 8, argsSize, 4);
+    putLittleEndian(fixed + 12, headerSize, 4);
+    putLittleEndian(fixed + 16,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(startedAt).count(), 8);
+    putLittleEndian(fixed + 24,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count(), 8);
+    putLittleEndian(fixed + 32, result.size(), 4);
+    fixed[36] = static_cast<char>(result.status());
+
+    static const char PADDING[8] = {};
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::fwrite(fixed, 1, sizeof fixed, _file);
+    std::fwrite(key.data(), 1, key.size(), _file);
+    if (argsSize > 0) {
+        std::fwrite(zframe_data(args), 1, argsSize, _file);
+    }
+    if (headerSize > 0) {
+        std::fwrite(zframe_data(headerFrame), 1, headerSize, _file);
+    }
+    std::fwrite(PADDING, 1, size - CAPTURE_RECORD_HEADER - bodySize, _file);
+
+    zframe_destroy(&header);
+    zframe_destroy(&plain);
+}
+
+CaptureReader::CaptureReader(const std::string &path)
+    : _data(nullptr)
+    , _size(0)
+    , _offset(sizeof CAPTURE_MAGIC)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+
+    if (_size > 0) {
+        void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map " + path);
+        }
+        _data = static_cast<const char *>(p);
+    }
+    close(fd);
+
+    if (_size < sizeof CAPTURE_MAGIC ||
+            std::memcmp(_data, CAPTURE_MAGIC, sizeof CAPTURE_MAGIC) != 0) {
+        if (_data) {
+            munmap(const_cast<char *>(_data), _size);
+        }
+        throw std::runtime_error(path + " is not a capture file");
+    }
+}
+
+CaptureReader::~CaptureReader()
+{
+    munmap(const_cast<char *>(_data), _size);
+}
+
+bool CaptureReader::next(CaptureEntry &entry)
+{
+    if (_size - _offset < CAPTURE_RECORD_HEADER) {
+        return false;
+    }
+
+    const char *p = _data + _offset;
+    const std::size_t size = getLittleEndian(p, 4);
+    const std::size_t keySize = getLittleEndian(p + 4, 4);
+    const std::size_t argsSize = getLittleEndian(p + 8, 4);
+    const std::size_t headerSize = getLittleEndian(p + 12, 4);
+    if (size > _size - _offset ||
+            CAPTURE_RECORD_HEADER + keySize + argsSize + headerSize > size) {
+        return false;
+    }
+
+    const char *body = p + CAPTURE_RECORD_HEADER;
+    entry.ecmKey = StringRef(body, keySize);
+    entry.args = StringRef(body + keySize, argsSize);
+    entry.header = StringRef(body + keySize + argsSize, headerSize);
+    entry.startedAt = std::chrono::nanoseconds(
+            static_cast<std::int64_t>(getLittleEndian(p + 16, 8)));
+    entry.latency = std::chrono::nanoseconds(
+            static_cast<std::int64_t>(getLittleEndian(p + 24, 8)));
+    entry.resultSize = getLittleEndian(p + 32, 4);
+    entry.status = static_cast<FunctionCallResult::Status>(p[36]);
+
+    _offset += size;
+    return true;
+}
+
+}
+
+}
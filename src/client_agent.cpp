@@ -1,11 +1,23 @@
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include <mutex>
-#include <thread>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 #include <czmq.h>
 
 #include "ecumene/client_agent.h"
+#include "ecumene/load_report.h"
 #include "ecumene/memory.h"
+#include "ecumene/message_header.h"
+#include "ecumene/partition.h"
+#include "ecumene/priority.h"
+#include "ecumene/stream.h"
 
 #define UNUSED(x) (void)(x)
 
@@ -13,6 +25,95 @@ namespace ecumene {
 
 static const uint16_t PROTOCOL_VERSION = 0;
 
+// Where workers are resolved, unless ECUMENE_REGISTRY names another
+static const char *REGISTRY_ENDPOINT = "tcp://ecumene.io:23332";
+
+// Calls and commands reach the actor here, from any thread
+static const char *SUBMIT_ENDPOINT = "inproc://ecumene-client-submit";
+
+// Gives the actor time to pick up what a thread sent just before exiting
+static const int SUBMIT_LINGER = 1000;
+
+// Submissions read back to back before queued calls go out by priority
+static const std::size_t MAX_INTAKE = 256;
+
+// Last chunk of an upload that could not be finished
+static const char *STREAM_ABORT = "!";
+
+// Assignments listing the live workers of a key, for partitioned calls
+static const char *MEMBERSHIP_ID = "*";
+
+// How often the workers of a partitioned key are listed again while in use
+static const std::chrono::seconds MEMBERSHIP_REFRESH(10);
+
+// Call IDs travel as decimal strings, which Ecumene and workers echo back
+static const std::size_t ID_LENGTH = 21;
+
+static void formatId(detail::CallTable::Id id, char (&text)[ID_LENGTH])
+{
+    std::snprintf(text, ID_LENGTH, "%llu", id);
+}
+
+static detail::CallTable::Id parseId(zframe_t *frame)
+{
+    const auto data = reinterpret_cast<const char *>(zframe_data(frame));
+    const std::size_t size = zframe_size(frame);
+
+    detail::CallTable::Id id = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        if (data[i] < '0' || data[i] > '9') {
+            return 0;
+        }
+        id = id * 10 + static_cast<detail::CallTable::Id>(data[i] - '0');
+    }
+    return id;
+}
+
+// Load reports are MessagePack maps, which no endpoint starts like
+static bool isLoadFrame(zframe_t *frame)
+{
+    if (zframe_size(frame) == 0) {
+        return false;
+    }
+
+    const unsigned char first = zframe_data(frame)[0];
+    return (first & 0xf0) == 0x80 || first == 0xde || first == 0xdf;
+}
+
+// Ecumene may offer several workers, each followed by its load report. Picks
+// the least loaded; workers without a report count as idle, and ties go to
+// the first offered.
+static std::string pickEndpoint(zmsg_t *assignment)
+{
+    std::string best;
+    double bestScore = 0;
+
+    zframe_t *frame = zmsg_first(assignment);
+    while (frame) {
+        std::string endpoint(
+                reinterpret_cast<const char *>(zframe_data(frame)),
+                zframe_size(frame));
+        double score = 0;
+
+        frame = zmsg_next(assignment);
+        if (frame && isLoadFrame(frame)) {
+            try {
+                score = detail::LoadReport::decode(frame).score();
+            } catch (...) {
+                zsys_warning("Ignoring malformed load report.");
+            }
+            frame = zmsg_next(assignment);
+        }
+
+        if (best.empty() || score < bestScore) {
+            best = std::move(endpoint);
+            bestScore = score;
+        }
+    }
+
+    return best;
+}
+
 ClientAgent &ClientAgent::sharedInstance()
 {
     static ClientAgent sharedInstance;
@@ -21,68 +122,163 @@ ClientAgent &ClientAgent::sharedInstance()
 
 void ClientAgent::send(FunctionCall &&call)
 {
-    static unsigned long long sequence = 0;
+    // One-way calls and broadcasts are never completed, so never recorded
+    call.captured = capturing && call.callback && !call.broadcast;
+
+    const Priority priority = call.priority;
+
+    detail::CallTable::Id id;
     {
         std::lock_guard<std::mutex> lock(callsMutex);
-        calls.insert(std::make_pair(sequence, std::move(call)));
+        id = calls.insert(std::move(call));
     }
-    {
-        std::lock_guard<std::mutex> lk(actorLock);
-        sendId = std::to_string(sequence++);
-        actorStatus = ActorStatus::SendRequested;
+
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, "$SEND");
+    zmsg_addmem(msg, &id, sizeof (id));
+    zmsg_addmem(msg, &priority, sizeof (priority));
+    command(msg);
+}
+
+void ClientAgent::setExecutor(const std::shared_ptr<Executor> &executor)
+{
+    assert(executor);
+
+    std::lock_guard<std::mutex> lock(executorMutex);
+    this->executor = executor;
+}
+
+void ClientAgent::prefetch(const std::vector<std::string> &ecmKeys)
+{
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, "$PREFETCH");
+    for (const auto &ecmKey: ecmKeys) {
+        zmsg_addstr(msg, ecmKey.c_str());
     }
-    actorCV.notify_one();
+    command(msg);
 }
 
-ClientAgent::ClientAgent()
-    : actorStatus(ActorStatus::NotReady)
+void ClientAgent::setEndpointCache(const std::string &path)
 {
-    std::thread([this]() {
-        zactor_t *actor = zactor_new(actorTask, this);
-        assert(actor);
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, "$CACHE");
+    zmsg_addstr(msg, path.c_str());
+    command(msg);
+}
 
-        {
-            std::lock_guard<std::mutex> lk(actorLock);
-            actorStatus = ActorStatus::Ready;
+void ClientAgent::command(zmsg_t *msg)
+{
+    // ZeroMQ sockets are not thread-safe, so each thread has its own
+    static thread_local const auto submit = []() {
+        auto sock = detail::makeSock(zsock_new_push(nullptr));
+        assert(sock.get());
+
+        zsock_set_sndhwm(sock.get(), 0);
+        zsock_set_linger(sock.get(), SUBMIT_LINGER);
+
+        const int rc = zsock_connect(sock.get(), "%s", SUBMIT_ENDPOINT);
+        UNUSED(rc);
+        assert(rc == 0);
+
+        return sock;
+    }();
+
+    zmsg_send(&msg, submit.get());
+}
+
+void ClientAgent::setCapture(const std::string &path)
+{
+    std::shared_ptr<detail::CaptureWriter> writer;
+    if (!path.empty()) {
+        writer = std::make_shared<detail::CaptureWriter>(path);
+        if (!writer->ok()) {
+            zsys_warning("Failed to open capture file %s.", path.c_str());
+            writer.reset();
         }
-        actorCV.notify_one();
+    }
 
-        bool shouldDestroy = false;
-        while (!shouldDestroy) {
-            std::unique_lock<std::mutex> lk(actorLock);
-            actorCV.wait(lk, [this] {
-                return actorStatus == ActorStatus::ShouldDestroy ||
-                    actorStatus == ActorStatus::SendRequested;
-            });
+    std::lock_guard<std::mutex> lock(captureMutex);
+    capture = std::move(writer);
+    capturing = static_cast<bool>(capture);
+}
 
-            if (actorStatus == ActorStatus::ShouldDestroy) {
-                shouldDestroy = true;
-            } else {
-                zstr_sendx(actor, "$SEND", sendId.c_str(), nullptr);
-                actorStatus = ActorStatus::Ready;
-            }
+void ClientAgent::complete(FunctionCall &&call, FunctionCallResult &&result)
+{
+    if (call.captured) {
+        std::shared_ptr<detail::CaptureWriter> capture;
+        {
+            std::lock_guard<std::mutex> lock(captureMutex);
+            capture = this->capture;
+        }
+        if (capture) {
+            capture->write(call, result);
         }
+    }
 
-        zactor_destroy(&actor);
+    if (!call.callback) {
+        return;
+    }
+    if (call.direct) {
+        call.callback(std::move(result));
+        return;
+    }
 
-        std::lock_guard<std::mutex> lk(actorLock);
-        actorStatus = ActorStatus::Destroyed;
-        actorCV.notify_one();
-    }).detach();
+    std::shared_ptr<Executor> executor;
+    {
+        std::lock_guard<std::mutex> lock(executorMutex);
+        executor = this->executor;
+    }
 
-    std::unique_lock<std::mutex> lk(actorLock);
-    actorCV.wait(lk, [this] { return actorStatus == ActorStatus::Ready; });
+    executor->execute([
+            callback = std::move(call.callback),
+            result = std::move(result)]() mutable {
+        callback(std::move(result));
+    });
 }
 
-ClientAgent::~ClientAgent()
+void ClientAgent::receive(
+        const std::shared_ptr<detail::Broadcast> &broadcast,
+        FunctionCallResult &&result)
 {
+    std::shared_ptr<Executor> executor;
     {
-        std::unique_lock<std::mutex> lk(actorLock);
-        actorStatus = ActorStatus::ShouldDestroy;
-        actorCV.notify_one();
-        actorCV.wait(lk, [this] { return actorStatus == ActorStatus::Destroyed; });
+        std::lock_guard<std::mutex> lock(executorMutex);
+        executor = this->executor;
     }
 
+    executor->execute([broadcast, result = std::move(result)]() {
+        broadcast->receive(result);
+    });
+}
+
+void ClientAgent::finish(
+        const std::shared_ptr<detail::Broadcast> &broadcast,
+        std::size_t answered)
+{
+    std::shared_ptr<Executor> executor;
+    {
+        std::lock_guard<std::mutex> lock(executorMutex);
+        executor = this->executor;
+    }
+
+    executor->execute([broadcast, answered]() {
+        broadcast->finish(answered);
+    });
+}
+
+ClientAgent::ClientAgent()
+    : actor(nullptr)
+    , executor(std::make_shared<ThreadPoolExecutor>())
+    , capturing(false)
+{
+    actor = zactor_new(actorTask, this);
+    assert(actor);
+}
+
+ClientAgent::~ClientAgent()
+{
+    zactor_destroy(&actor);
+
     zsys_info("Cleaned up client agent.");
 }
 
@@ -93,23 +289,481 @@ void ClientAgent::actorTask(zsock_t *pipe, void *args)
 
     ClientAgent &agent = *static_cast<ClientAgent *>(args);
 
-    const auto ecm = detail::makeSock(zsock_new_dealer("tcp://ecumene.io:23332"));
+    const char *registry = std::getenv("ECUMENE_REGISTRY");
+    const auto ecm = detail::makeSock(
+            zsock_new_dealer(registry ? registry : REGISTRY_ENDPOINT));
     assert(ecm.get());
 
-    const auto poller = detail::makePoller(zpoller_new(pipe, ecm.get(), nullptr));
+    const auto submit = detail::makeSock(zsock_new_pull(nullptr));
+    assert(submit.get());
+    zsock_set_rcvhwm(submit.get(), 0);
+    int rc = zsock_bind(submit.get(), "%s", SUBMIT_ENDPOINT);
+    assert(rc == 0);
+
+    const auto poller = detail::makePoller(
+            zpoller_new(pipe, submit.get(), ecm.get(), nullptr));
     assert(poller.get());
 
-    std::map<std::string, decltype(detail::makeSock(nullptr))> socks;
+    // Worker sockets, indexed by interned ecmKey
+    std::vector<decltype(detail::makeSock(nullptr))> socks;
+
+    // Report dropped connections of the worker sockets, same index. Declared
+    // after the sockets so that they are destroyed first.
+    std::vector<decltype(detail::makeActor(nullptr))> monitors;
+    std::unordered_map<void *, detail::EcmKey> monitorKeys;
+
+    // Endpoint of each worker socket, same index
+    std::vector<std::string> endpoints;
+
+    // On-disk copy of `endpoints`, if any
+    std::string cachePath;
+
+    // Sockets for broadcasts and partitioned calls, by endpoint. Those only
+    // partitioned calls use are closed once their worker leaves.
+    struct Peer {
+        decltype(detail::makeSock(nullptr)) sock;
+        bool broadcast = false;
+    };
+    std::map<std::string, Peer> peers;
 
-    int rc = zsock_signal(pipe, 0);
+    // Live workers of each key partitioned calls are made to, and the calls
+    // waiting for the first list
+    struct Membership {
+        detail::Rendezvous workers;
+        std::vector<detail::CallTable::Id> waiting;
+        std::chrono::steady_clock::time_point listedAt;
+        bool listing = false;
+        bool used = false;
+    };
+    std::unordered_map<detail::EcmKey, Membership> memberships;
+
+    // Reused across iterations
+    std::vector<FunctionCall> timedOut;
+    std::vector<FunctionCall> undefined;
+    std::vector<detail::CallTable::Id> resend;
+    std::vector<detail::CallTable::Id> aborted;
+
+    // Uploads that may have credits to spend, pumped once the calls lock is
+    // released so that producing chunks doesn't hold up other threads
+    std::vector<std::pair<zsock_t *, detail::CallTable::Id>> uploading;
+
+    // Submitted calls not dispatched yet, and how many submissions have been
+    // read since the last dispatch
+    detail::PriorityQueue<detail::CallTable::Id> queued;
+    std::size_t intake = 0;
+
+    rc = zsock_signal(pipe, 0);
     UNUSED(rc);
     assert(rc == 0);
 
+    // Asks Ecumene for a worker of `key`, or for all of them. Assignments for
+    // call ID 0 only connect.
+    const auto resolve = [&](const char *idText, detail::EcmKey key, bool all) {
+        zmsg_t *workerRequest = zmsg_new();
+        zframe_t *version =
+            zframe_new(&PROTOCOL_VERSION, sizeof (uint16_t));
+        zmsg_append(workerRequest, &version);
+        zmsg_addstr(workerRequest, idText);
+        zmsg_addstr(workerRequest, detail::ecmKeyName(key).c_str());
+        if (all) {
+            // Every live endpoint, not just one
+            zmsg_addstr(workerRequest, "*");
+        }
+
+        rc = zmsg_send(&workerRequest, ecm.get());
+        assert(rc == 0);
+    };
+
+    const auto connected = [&](detail::EcmKey key) {
+        return key < socks.size() && socks[key];
+    };
+
+    // Writes the endpoints in use to the cache, if any
+    const auto save = [&]() {
+        if (cachePath.empty()) {
+            return;
+        }
+
+        const std::string tmpPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            for (detail::EcmKey key = 0; key < endpoints.size(); ++key) {
+                if (!endpoints[key].empty()) {
+                    out << detail::ecmKeyName(key) << '\t' << endpoints[key] << '\n';
+                }
+            }
+        }
+
+        if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+            zsys_warning("Failed to write endpoint cache %s.", cachePath.c_str());
+        }
+    };
+
+    // Opens the worker socket of `key`
+    const auto connect = [&](detail::EcmKey key, const std::string &endpoint) {
+        zsys_debug("Connecting to worker...");
+
+        if (key >= socks.size()) {
+            socks.resize(key + 1);
+            monitors.resize(key + 1);
+            endpoints.resize(key + 1);
+        }
+
+        auto worker = detail::makeSock(zsock_new_dealer(endpoint.c_str()));
+        assert(worker.get());
+
+        // A refused connect means nobody is listening any more
+        auto monitor = detail::makeActor(zactor_new(zmonitor, worker.get()));
+        assert(monitor.get());
+        zstr_sendx(
+                monitor.get(),
+                "LISTEN",
+                "DISCONNECTED",
+                "CONNECT_RETRIED",
+                nullptr);
+        zstr_sendx(monitor.get(), "START", nullptr);
+        zsock_wait(monitor.get());
+
+        rc = zpoller_add(poller.get(), worker.get());
+        assert(rc == 0);
+
+        rc = zpoller_add(poller.get(), monitor.get());
+        assert(rc == 0);
+
+        monitorKeys[monitor.get()] = key;
+        socks[key] = std::move(worker);
+        monitors[key] = std::move(monitor);
+        endpoints[key] = endpoint;
+
+        save();
+    };
+
+    // Whether no call waits on the worker of `key`
+    const auto idle = [&](detail::EcmKey key) {
+        std::lock_guard<std::mutex> lock(agent.callsMutex);
+
+        bool busy = false;
+        agent.calls.forEach([&](detail::CallTable::Id, FunctionCall &call) {
+            busy = busy ||
+                (call.ecmKey == key && call.sent && !call.broadcast && !call.partitioned);
+        });
+        return !busy;
+    };
+
+    // Socket to the worker at `endpoint`, shared by broadcasts and
+    // partitioned calls
+    const auto peer = [&](const std::string &endpoint, bool broadcast) -> zsock_t * {
+        Peer &peer = peers[endpoint];
+        if (!peer.sock) {
+            peer.sock = detail::makeSock(zsock_new_dealer(endpoint.c_str()));
+            assert(peer.sock.get());
+
+            rc = zpoller_add(poller.get(), peer.sock.get());
+            assert(rc == 0);
+        }
+        peer.broadcast = peer.broadcast || broadcast;
+        return peer.sock.get();
+    };
+
+    // Lists the live workers of `key` unless that is under way
+    const auto list = [&](detail::EcmKey key) {
+        Membership &membership = memberships[key];
+        if (!membership.listing) {
+            membership.listing = true;
+            resolve(MEMBERSHIP_ID, key, true);
+        }
+    };
+
+    // Sends upload chunks while the worker has room for them. Called without
+    // the calls lock, which is only taken to read and update the credits.
+    const auto pump = [&](zsock_t *worker, detail::CallTable::Id id) {
+        std::shared_ptr<detail::UploadSource> upload;
+        std::size_t credits = 0;
+        {
+            std::lock_guard<std::mutex> lock(agent.callsMutex);
+            FunctionCall *call = agent.calls.find(id);
+            if (!call || !call->upload || call->uploaded) {
+                return;
+            }
+            upload = call->upload;
+            credits = call->credits;
+        }
+
+        char idText[ID_LENGTH];
+        formatId(id, idText);
+
+        std::size_t spent = 0;
+        bool uploaded = false;
+        while (!uploaded && spent < credits) {
+            detail::MessageHeader chunkHeader;
+            chunkHeader.set(detail::MessageHeader::Chunk);
+
+            zframe_t *chunk;
+            try {
+                chunk = upload->next();
+                if (!chunk) {
+                    chunkHeader.set(detail::MessageHeader::StreamEnd);
+                    chunk = zframe_new_empty();
+                    uploaded = true;
+                }
+            } catch (...) {
+                // Abort the stream so that the worker drops it, and fail the
+                // call along with the timed out ones
+                chunkHeader.set(detail::MessageHeader::StreamEnd);
+                chunk = zframe_new(STREAM_ABORT, 1);
+                uploaded = true;
+                aborted.push_back(id);
+            }
+
+            rc = zstr_sendm(worker, idText);
+            assert(rc == 0);
+            rc = zframe_send(&chunk, worker, ZFRAME_MORE);
+            assert(rc == 0);
+            zframe_t *headerFrame = chunkHeader.encode();
+            rc = zframe_send(&headerFrame, worker, 0);
+            assert(rc == 0);
+
+            ++spent;
+        }
+
+        std::lock_guard<std::mutex> lock(agent.callsMutex);
+        FunctionCall *call = agent.calls.find(id);
+        if (call) {
+            call->credits -= spent;
+            call->uploaded = call->uploaded || uploaded;
+        }
+    };
+
+    // Writes a call to a worker socket. Frames that may have to be sent again
+    // are kept. Upload chunks follow once the calls lock is released.
+    const auto sendCall = [&](zsock_t *worker, const char *idText, FunctionCall *call) {
+        const int reuse =
+            call->idempotent || !call->blobs.empty() || call->captured ? ZFRAME_REUSE : 0;
+
+        rc = zstr_sendm(worker, idText);
+        assert(rc == 0);
+
+        rc = zframe_send(
+                &call->args,
+                worker,
+                reuse | (call->header ? ZFRAME_MORE : 0));
+        assert(rc == 0);
+
+        if (call->header) {
+            rc = zframe_send(&call->header, worker, reuse);
+            assert(rc == 0);
+        }
+
+        call->sent = true;
+
+        if (call->upload) {
+            uploading.emplace_back(worker, std::strtoull(idText, nullptr, 10));
+        }
+    };
+
+    // Sends a call to its worker, or asks Ecumene for one first
+    const auto dispatch = [&](detail::CallTable::Id id) {
+        std::lock_guard<std::mutex> lock(agent.callsMutex);
+
+        FunctionCall *call = agent.calls.find(id);
+        if (!call || call->sent) {
+            // Already answered, timed out or sent
+            return;
+        }
+
+        char idText[ID_LENGTH];
+        formatId(id, idText);
+
+        if (call->partitioned) {
+            // The worker the partition hashes to, once the workers are known
+            Membership &membership = memberships[call->ecmKey];
+            membership.used = true;
+            if (membership.workers.empty()) {
+                membership.waiting.push_back(id);
+                list(call->ecmKey);
+                return;
+            }
+
+            call->peer = peer(membership.workers.pick(call->partition), false);
+            sendCall(call->peer, idText, call);
+
+            if (!call->callback) {
+                agent.calls.erase(id);
+            }
+        } else if (!call->broadcast && connected(call->ecmKey)) {
+            // Use existing worker socket
+            sendCall(socks[call->ecmKey].get(), idText, call);
+
+            if (!call->callback) {
+                // One-way, nothing to wait for
+                agent.calls.erase(id);
+            }
+        } else {
+            // Ask Ecumene for new worker
+            resolve(idText, call->ecmKey, static_cast<bool>(call->broadcast));
+        }
+    };
+
+    // Sends a broadcast to each endpoint left in `endpoints`. Returns false
+    // if the call is not a broadcast.
+    const auto fanOut = [&](detail::CallTable::Id id, zmsg_t *endpoints) {
+        std::unique_lock<std::mutex> lock(agent.callsMutex);
+
+        FunctionCall *call = agent.calls.find(id);
+        if (!call || !call->broadcast) {
+            return false;
+        }
+        if (call->sent) {
+            return true;
+        }
+
+        char idText[ID_LENGTH];
+        formatId(id, idText);
+
+        const int more = call->header ? ZFRAME_MORE : 0;
+
+        char *endpointData;
+        while ((endpointData = zmsg_popstr(endpoints))) {
+            std::unique_ptr<char> endpoint(endpointData);
+
+            zframe_t *next = zmsg_first(endpoints);
+            if (next && isLoadFrame(next)) {
+                // Everyone is asked regardless
+                zmsg_remove(endpoints, next);
+                zframe_destroy(&next);
+            }
+
+            zsock_t *worker = peer(endpoint.get(), true);
+
+            // Same frames for everyone
+            rc = zstr_sendm(worker, idText);
+            assert(rc == 0);
+
+            rc = zframe_send(&call->args, worker, ZFRAME_REUSE | more);
+            assert(rc == 0);
+
+            if (call->header) {
+                rc = zframe_send(&call->header, worker, ZFRAME_REUSE);
+                assert(rc == 0);
+            }
+
+            ++call->asked;
+        }
+
+        zframe_destroy(&call->args);
+        zframe_destroy(&call->header);
+        call->sent = true;
+
+        if (call->asked == 0) {
+            // No workers at all
+            const auto broadcast = std::move(call->broadcast);
+            agent.calls.erase(id);
+            lock.unlock();
+
+            agent.finish(broadcast, 0);
+        }
+        return true;
+    };
+
+    // Forgets the worker of `key` once its connection drops, so the next
+    // call asks Ecumene again. Idempotent calls it still owed an answer are
+    // sent again, the others fail right away.
+    const auto drop = [&](detail::EcmKey key) {
+        zsys_debug("Lost worker of %s.", detail::ecmKeyName(key).c_str());
+
+        monitorKeys.erase(monitors[key].get());
+        zpoller_remove(poller.get(), monitors[key].get());
+        zpoller_remove(poller.get(), socks[key].get());
+        monitors[key].reset();
+        socks[key].reset();
+        endpoints[key].clear();
+        save();
+
+        {
+            std::lock_guard<std::mutex> lock(agent.callsMutex);
+
+            agent.calls.forEach([&](detail::CallTable::Id id, FunctionCall &call) {
+                if (call.ecmKey == key && call.sent && !call.broadcast &&
+                        !call.partitioned) {
+                    resend.push_back(id);
+                }
+            });
+
+            for (auto &id: resend) {
+                FunctionCall *call = agent.calls.find(id);
+                if (call->idempotent) {
+                    call->sent = false;
+                } else {
+                    timedOut.push_back(std::move(*call));
+                    agent.calls.erase(id);
+                    id = 0;
+                }
+            }
+        }
+
+        for (const auto id: resend) {
+            if (id) {
+                dispatch(id);
+            }
+        }
+        resend.clear();
+    };
+
+    // Closes the sockets of workers that partitioned calls no longer go to.
+    // Idempotent calls still waiting on one are sent again, the others fail
+    // right away.
+    const auto retire = [&]() {
+        for (auto it = peers.begin(); it != peers.end();) {
+            bool referenced = it->second.broadcast;
+            for (const auto &entry: memberships) {
+                referenced = referenced || entry.second.workers.contains(it->first);
+            }
+            if (referenced) {
+                ++it;
+                continue;
+            }
+
+            zsock_t *sock = it->second.sock.get();
+            {
+                std::lock_guard<std::mutex> lock(agent.callsMutex);
+
+                agent.calls.forEach([&](detail::CallTable::Id id, FunctionCall &call) {
+                    if (call.partitioned && call.sent && call.peer == sock) {
+                        resend.push_back(id);
+                    }
+                });
+
+                for (auto &id: resend) {
+                    FunctionCall *call = agent.calls.find(id);
+                    if (call->idempotent) {
+                        call->sent = false;
+                        call->peer = nullptr;
+                    } else {
+                        timedOut.push_back(std::move(*call));
+                        agent.calls.erase(id);
+                        id = 0;
+                    }
+                }
+            }
+
+            zpoller_remove(poller.get(), sock);
+            it = peers.erase(it);
+        }
+
+        for (const auto id: resend) {
+            if (id) {
+                dispatch(id);
+            }
+        }
+        resend.clear();
+    };
+
     bool terminated = false;
     while (!terminated && !zsys_interrupted) {
-        zsock_t *sock = static_cast<zsock_t *>(zpoller_wait(poller.get(), 1000));
+        zsock_t *sock = static_cast<zsock_t *>(
+                zpoller_wait(poller.get(), queued.empty() ? 1000 : 0));
 
-        if (sock == pipe) {
+        if (sock == pipe || sock == submit.get()) {
             // Internal command
 
             auto msg = detail::makeMsg(zmsg_recv(sock));
@@ -120,147 +774,336 @@ void ClientAgent::actorTask(zsock_t *pipe, void *args)
 
             if (zframe_streq(command.get(), "$TERM")) {
                 terminated = true;
-            } else if (zframe_streq(command.get(), "$SEND")) {
-                std::unique_ptr<char> id(zmsg_popstr(msg.get()));
+            } else if (zframe_streq(command.get(), "$PREFETCH")) {
+                char *ecmKeyData;
+                while ((ecmKeyData = zmsg_popstr(msg.get()))) {
+                    std::unique_ptr<char> ecmKey(ecmKeyData);
 
-                std::lock_guard<std::mutex> lock(agent.callsMutex);
+                    const detail::EcmKey key = detail::internEcmKey(ecmKey.get());
+                    if (!connected(key)) {
+                        resolve("0", key, false);
+                    }
+                }
+            } else if (zframe_streq(command.get(), "$CACHE")) {
+                std::unique_ptr<char> path(zmsg_popstr(msg.get()));
+                assert(path.get());
 
-                char *end;
-                const auto iterCall =
-                    agent.calls.find(std::strtoull(id.get(), &end, 10));
-                if (iterCall != agent.calls.cend()) {
-                    auto &call = iterCall->second;
-                    assert(call.args);
+                // Connect to cached endpoints right away, and check them with
+                // Ecumene in the meantime
+                std::ifstream in(path.get());
+                cachePath = path.get();
 
-                    const auto iterSock = socks.find(call.ecmKey);
-                    if (iterSock != socks.cend()) {
-                        // Use existing worker socket
-                        const auto &worker = iterSock->second;
-                        assert(worker.get());
+                std::string line;
+                while (std::getline(in, line)) {
+                    const auto tab = line.find('\t');
+                    if (tab == std::string::npos) {
+                        continue;
+                    }
 
-                        rc = zstr_sendm(worker.get(), id.get());
-                        assert(rc == 0);
+                    const detail::EcmKey key =
+                        detail::internEcmKey(line.substr(0, tab));
+                    if (!connected(key)) {
+                        connect(key, line.substr(tab + 1));
+                    }
+                    resolve("0", key, false);
+                }
 
-                        rc = zmsg_send(&call.args, worker.get());
-                        assert(rc == 0);
-                    } else {
-                        // Ask Ecumene for new worker
+                save();
+            } else if (zframe_streq(command.get(), "$SEND")) {
+                // Array of call IDs, then their priority
+                auto ids = detail::makeFrame(zmsg_pop(msg.get()));
+                assert(ids.get());
 
-                        zmsg_t *workerRequest = zmsg_new();
-                        zframe_t *version =
-                            zframe_new(&PROTOCOL_VERSION, sizeof (uint16_t));
-                        zmsg_append(workerRequest, &version);
-                        zmsg_addstr(workerRequest, id.get());
-                        zmsg_addstr(workerRequest, call.ecmKey.c_str());
+                Priority priority = Priority::Normal;
+                auto priorityFrame = detail::makeFrame(zmsg_pop(msg.get()));
+                if (priorityFrame.get() && zframe_size(priorityFrame.get()) == sizeof (priority)) {
+                    std::memcpy(&priority, zframe_data(priorityFrame.get()), sizeof (priority));
+                }
 
-                        rc = zmsg_send(&workerRequest, ecm.get());
-                        assert(rc == 0);
-                    }
+                const std::size_t count =
+                    zframe_size(ids.get()) / sizeof (detail::CallTable::Id);
+                for (std::size_t i = 0; i < count; ++i) {
+                    detail::CallTable::Id id;
+                    std::memcpy(
+                            &id,
+                            zframe_data(ids.get()) + i * sizeof (id),
+                            sizeof (id));
+                    queued.push(std::move(id), priority);
                 }
             }
         } else if (sock == ecm.get()) {
             // Worker assignment from Ecumene
             zsys_debug("Assigned!");
 
-            char *idData, *ecmKeyData, *statusData, *endpointData;
-            rc = zstr_recvx(
-                    sock,
-                    &idData,
-                    &ecmKeyData,
-                    &statusData,
-                    &endpointData,
-                    nullptr);
-            assert(rc == 4);
+            auto assignment = detail::makeMsg(zmsg_recv(sock));
+            assert(assignment.get());
+            assert(zmsg_size(assignment.get()) >= 4);
 
             // RAII protection
-            std::unique_ptr<char> id(idData),
-                                  ecmKey(ecmKeyData),
-                                  status(statusData),
-                                  endpoint(endpointData);
+            std::unique_ptr<char> id(zmsg_popstr(assignment.get())),
+                                  ecmKey(zmsg_popstr(assignment.get())),
+                                  status(zmsg_popstr(assignment.get()));
 
-            if (streq(status.get(), "")) {
-                // Success
+            char *end;
+            const detail::CallTable::Id callId = std::strtoull(id.get(), &end, 10);
+
+            if (streq(id.get(), MEMBERSHIP_ID)) {
+                // Live workers of a partitioned key
+                Membership &membership =
+                    memberships[detail::internEcmKey(ecmKey.get())];
+                membership.listing = false;
+                membership.used = false;
+                membership.listedAt = std::chrono::steady_clock::now();
+
+                std::vector<std::string> workers;
+                if (streq(status.get(), "")) {
+                    zframe_t *frame = zmsg_first(assignment.get());
+                    for (; frame; frame = zmsg_next(assignment.get())) {
+                        if (!isLoadFrame(frame)) {
+                            workers.emplace_back(
+                                    reinterpret_cast<const char *>(zframe_data(frame)),
+                                    zframe_size(frame));
+                        }
+                    }
+                }
+                if (!workers.empty() || streq(status.get(), "U")) {
+                    membership.workers.assign(std::move(workers));
+                }
+
+                resend.swap(membership.waiting);
+                if (membership.workers.empty()) {
+                    // Nobody serves the key
+                    std::lock_guard<std::mutex> lock(agent.callsMutex);
+                    for (const auto waiting: resend) {
+                        FunctionCall *call = agent.calls.find(waiting);
+                        if (call) {
+                            undefined.push_back(std::move(*call));
+                            agent.calls.erase(waiting);
+                        }
+                    }
+                    resend.clear();
+                }
 
-                if (socks.find(ecmKey.get()) == socks.cend()) {
-                    zsys_debug("Connecting to worker...");
+                for (const auto waiting: resend) {
+                    dispatch(waiting);
+                }
+                resend.clear();
 
-                    auto worker = detail::makeSock(zsock_new_dealer(endpoint.get()));
-                    assert(worker.get());
+                retire();
+            } else if (streq(status.get(), "") && fanOut(callId, assignment.get())) {
+                // Broadcast, the rest were endpoints
+            } else if (streq(status.get(), "")) {
+                // Success
 
-                    rc = zpoller_add(poller.get(), worker.get());
-                    assert(rc == 0);
+                const std::string endpoint = pickEndpoint(assignment.get());
+                const detail::EcmKey key = detail::internEcmKey(ecmKey.get());
 
-                    socks.insert(std::make_pair(ecmKey.get(), std::move(worker)));
+                if (callId == 0 && connected(key) &&
+                        endpoints[key] != endpoint && idle(key)) {
+                    // Cached or prefetched endpoint is not the one Ecumene
+                    // would pick now; switch while nothing is in flight
+                    drop(key);
                 }
 
-                {
-                    std::lock_guard<std::mutex> lk(agent.actorLock);
-                    agent.sendId = id.get();
-                    agent.actorStatus = ActorStatus::SendRequested;
+                if (!connected(key)) {
+                    connect(key, endpoint);
                 }
-                agent.actorCV.notify_one();
+
+                dispatch(callId);
             } else if (streq(status.get(), "U")) {
                 // Undefined reference
 
+                const detail::EcmKey key = detail::internEcmKey(ecmKey.get());
+                if (callId == 0 && connected(key)) {
+                    // Cached endpoint of a key that is gone
+                    drop(key);
+                }
+
                 std::unique_lock<std::mutex> lock(agent.callsMutex);
 
-                char *end;
-                const auto it = agent.calls.find(std::strtoull(id.get(), &end, 10));
-                if (it != agent.calls.cend()) {
-                    auto call = std::move(it->second);
-                    agent.calls.erase(it);
+                FunctionCall *found = agent.calls.find(callId);
+                if (found) {
+                    auto call = std::move(*found);
+                    agent.calls.erase(callId);
                     lock.unlock();
 
                     zframe_t *statusFrame = zframe_new("U", 1);
                     zframe_t *resultFrame = zframe_new_empty();
-                    call.callback(FunctionCallResult(&statusFrame, &resultFrame));
+                    FunctionCallResult result(&statusFrame, &resultFrame);
+
+                    if (call.broadcast) {
+                        agent.receive(call.broadcast, std::move(result));
+                        agent.finish(call.broadcast, 1);
+                    } else {
+                        agent.complete(std::move(call), std::move(result));
+                    }
                 }
             }
+        } else if (sock && monitorKeys.count(sock)) {
+            // Connection of some worker socket dropped
+            auto event = detail::makeMsg(zmsg_recv(sock));
+            assert(event.get());
+
+            drop(monitorKeys[sock]);
         } else if (sock) {
             // Response from some worker
-            
+
             zmsg_t *msg = zmsg_recv(sock);
             assert(msg);
-            assert(zmsg_size(msg) == 3);
+            assert(zmsg_size(msg) >= 3);
+
+            auto idFrame = detail::makeFrame(zmsg_pop(msg));
+            const detail::CallTable::Id callId = parseId(idFrame.get());
 
-            // RAII protection
-            std::unique_ptr<char> id(zmsg_popstr(msg));
             zframe_t *statusFrame = zmsg_pop(msg);
             zframe_t *resultFrame = zmsg_pop(msg);
-            FunctionCallResult result(&statusFrame, &resultFrame);
-            zmsg_destroy(&msg);
+            if (zframe_streq(statusFrame, "C")) {
+                // Worker has read some upload chunks, send more. The count is
+                // little-endian.
+                std::size_t credits = 0;
+                for (std::size_t i = zframe_size(resultFrame); i > 0; --i) {
+                    credits = (credits << 8) | zframe_data(resultFrame)[i - 1];
+                }
+                zframe_destroy(&statusFrame);
+                zframe_destroy(&resultFrame);
+                zmsg_destroy(&msg);
 
-            std::unique_lock<std::mutex> lock(agent.callsMutex);
+                std::lock_guard<std::mutex> lock(agent.callsMutex);
+                FunctionCall *found = agent.calls.find(callId);
+                if (found && found->upload) {
+                    found->credits += credits;
+                    uploading.emplace_back(sock, callId);
+                }
+            } else {
+                const bool blobMissing = zframe_streq(statusFrame, "B");
 
-            char *end;
-            const auto it = agent.calls.find(std::strtoull(id.get(), &end, 10));
-            if (it != agent.calls.cend()) {
-                auto call = std::move(it->second);
-                agent.calls.erase(it);
-                lock.unlock();
+                detail::MessageHeader header;
+                if (zmsg_size(msg) > 0) {
+                    auto headerFrame = detail::makeFrame(zmsg_pop(msg));
+                    try {
+                        header = detail::MessageHeader::decode(headerFrame.get());
+                    } catch (...) {
+                        zsys_warning("Ignoring malformed response header.");
+                    }
+                }
+
+                FunctionCallResult result(&statusFrame, &resultFrame, header);
+                zmsg_destroy(&msg);
+
+                std::unique_lock<std::mutex> lock(agent.callsMutex);
+
+                FunctionCall *found = agent.calls.find(callId);
+                if (found && blobMissing && !found->blobs.empty()) {
+                    // Worker lacks some blobs, send them along this time
+                    found->inlineBlobs();
+
+                    char idText[ID_LENGTH];
+                    formatId(callId, idText);
+                    sendCall(sock, idText, found);
+                } else if (found && found->broadcast) {
+                    // One of several answers
+                    const auto broadcast = found->broadcast;
+                    const std::size_t answered = ++found->answered;
+                    const bool last = answered == found->asked;
+                    if (last) {
+                        agent.calls.erase(callId);
+                    }
+                    lock.unlock();
+
+                    agent.receive(broadcast, std::move(result));
+                    if (last) {
+                        agent.finish(broadcast, answered);
+                    }
+                } else if (found) {
+                    auto call = std::move(*found);
+                    agent.calls.erase(callId);
+                    lock.unlock();
 
-                call.callback(std::move(result));
+                    agent.complete(std::move(call), std::move(result));
+                }
             }
         }
 
+        // Once the submissions at hand are read, or enough of them, the
+        // queued calls go out highest priority first
+        if (!queued.empty() &&
+                (!(zsock_events(submit.get()) & ZMQ_POLLIN) || ++intake >= MAX_INTAKE)) {
+            while (!queued.empty()) {
+                dispatch(queued.pop());
+            }
+            intake = 0;
+        }
+
+        for (const auto &upload: uploading) {
+            pump(upload.first, upload.second);
+        }
+        uploading.clear();
+
         // Check timeout
-        std::lock_guard<std::mutex> lock(agent.callsMutex);
+        {
+            std::lock_guard<std::mutex> lock(agent.callsMutex);
 
-        auto now = std::chrono::steady_clock::now();
+            for (const auto id: aborted) {
+                FunctionCall *call = agent.calls.find(id);
+                if (call) {
+                    timedOut.push_back(std::move(*call));
+                    agent.calls.erase(id);
+                }
+            }
+            aborted.clear();
 
-        auto it = agent.calls.begin();
-        while (it != agent.calls.end()) {
-            if (now >= it->second.timeoutAt) {
-                auto call = std::move(it->second);
-                it = agent.calls.erase(it);
+            auto now = std::chrono::steady_clock::now();
 
-                zframe_t *statusFrame = zframe_new("N", 1);
-                zframe_t *resultFrame = zframe_new_empty();
-                call.callback(FunctionCallResult(&statusFrame, &resultFrame));
-            } else {
-                ++it;
+            detail::CallTable::Id expired;
+            while ((expired = agent.calls.nextExpired(now)) != 0) {
+                FunctionCall *call = agent.calls.find(expired);
+                if (call->partitioned) {
+                    // Its worker may be gone, list them again
+                    Membership &membership = memberships[call->ecmKey];
+                    membership.listedAt = std::chrono::steady_clock::time_point();
+                    membership.used = true;
+                }
+                timedOut.push_back(std::move(*call));
+                agent.calls.erase(expired);
             }
         }
+
+        // Keep the workers of partitioned keys in use up to date
+        {
+            const auto now = std::chrono::steady_clock::now();
+            for (auto &entry: memberships) {
+                Membership &membership = entry.second;
+                if (membership.used && !membership.listing &&
+                        now - membership.listedAt >= MEMBERSHIP_REFRESH) {
+                    list(entry.first);
+                }
+            }
+        }
+
+        for (auto &call: undefined) {
+            zframe_t *statusFrame = zframe_new("U", 1);
+            zframe_t *resultFrame = zframe_new_empty();
+            agent.complete(
+                    std::move(call),
+                    FunctionCallResult(&statusFrame, &resultFrame));
+        }
+        undefined.clear();
+
+        // Completed outside the lock, along with calls lost with a worker
+        for (auto &call: timedOut) {
+            if (call.broadcast) {
+                // Whatever arrived in time
+                agent.finish(call.broadcast, call.answered);
+                continue;
+            }
+
+            zframe_t *statusFrame = zframe_new("N", 1);
+            zframe_t *resultFrame = zframe_new_empty();
+            agent.complete(
+                    std::move(call),
+                    FunctionCallResult(&statusFrame, &resultFrame));
+        }
+        timedOut.clear();
     }
 }
 
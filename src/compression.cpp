@@ -0,0 +1,125 @@
+#include <cstdint>
+#include <vector>
+
+#include <czmq.h>
+#include <lz4.h>
+
+#include "ecumene/compression.h"
+#include "ecumene/exception.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Compressed payloads start with the little-endian uncompressed size
+static const std::size_t SIZE_PREFIX = sizeof (std::uint32_t);
+
+// Decompression buffers above this size are freed after use
+static const std::size_t MAX_RETAINED_SIZE = 1 << 20;
+
+// LZ4 never expands one byte of input into more than this many
+static const std::uint64_t MAX_RATIO = 255;
+
+static thread_local std::vector<char> decompressed;
+
+// Frees an oversized decompression buffer on the way out, thrown or not
+struct TrimDecompressed {
+    ~TrimDecompressed()
+    {
+        if (decompressed.capacity() > MAX_RETAINED_SIZE) {
+            std::vector<char>().swap(decompressed);
+        }
+    }
+};
+
+zframe_t *makePayloadFrame(
+        const char *data,
+        std::size_t size,
+        std::size_t threshold,
+        bool &compressed)
+{
+    compressed = false;
+
+    if (size < threshold || size > LZ4_MAX_INPUT_SIZE) {
+        return zframe_new(data, size);
+    }
+
+    const int bound = LZ4_compressBound(static_cast<int>(size));
+    zframe_t *frame = zframe_new(nullptr, SIZE_PREFIX + bound);
+    assert(frame);
+
+    char *dst = reinterpret_cast<char *>(zframe_data(frame));
+    const int written = LZ4_compress_default(
+            data,
+            dst + SIZE_PREFIX,
+            static_cast<int>(size),
+            bound);
+
+    if (written <= 0 || SIZE_PREFIX + written >= size) {
+        // Not worth it
+        zframe_destroy(&frame);
+        return zframe_new(data, size);
+    }
+
+    const auto rawSize = static_cast<std::uint32_t>(size);
+    for (std::size_t i = 0; i < SIZE_PREFIX; ++i) {
+        dst[i] = static_cast<char>((rawSize >> (8 * i)) & 0xff);
+    }
+
+    // Only the compressed part is worth keeping around
+    zframe_t *trimmed = zframe_new(dst, SIZE_PREFIX + written);
+    zframe_destroy(&frame);
+
+    compressed = true;
+    return trimmed;
+}
+
+msgpack::object unpackPayload(
+        const char *data,
+        std::size_t size,
+        bool compressed,
+        msgpack::zone &zone)
+{
+    if (!compressed) {
+        return msgpack::unpack(zone, data, size);
+    }
+
+    if (size < SIZE_PREFIX) {
+        throw InvalidArgument("truncated compressed payload");
+    }
+
+    std::uint32_t rawSize = 0;
+    for (std::size_t i = 0; i < SIZE_PREFIX; ++i) {
+        rawSize |= static_cast<std::uint32_t>(
+                static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    if (rawSize > LZ4_MAX_INPUT_SIZE) {
+        throw InvalidArgument("compressed payload too large");
+    }
+
+    // The size comes from the peer, so it must be one the input could
+    // actually decompress to before anything is allocated for it
+    if (rawSize > (size - SIZE_PREFIX) * MAX_RATIO) {
+        throw InvalidArgument("corrupt compressed payload");
+    }
+
+    const TrimDecompressed trim;
+    decompressed.resize(rawSize);
+
+    const int n = LZ4_decompress_safe(
+            data + SIZE_PREFIX,
+            decompressed.data(),
+            static_cast<int>(size - SIZE_PREFIX),
+            static_cast<int>(rawSize));
+    if (n < 0 || static_cast<std::uint32_t>(n) != rawSize) {
+        throw InvalidArgument("corrupt compressed payload");
+    }
+
+    // Strings and binaries are copied into the zone, so the buffer is free
+    // again as soon as this returns
+    return msgpack::unpack(zone, decompressed.data(), rawSize);
+}
+
+}
+
+}
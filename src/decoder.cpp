@@ -0,0 +1,342 @@
+#include <cstring>
+
+#include "ecumene/decoder.h"
+#include "ecumene/exception.h"
+
+namespace ecumene {
+
+namespace detail {
+
+Reader::Reader(const char *data, std::size_t size)
+    : _data(data)
+    , _size(size)
+    , _offset(0)
+{
+}
+
+const char *Reader::take(std::size_t n)
+{
+    if (n > _size - _offset) {
+        throw InvalidArgument("truncated payload");
+    }
+
+    const char *p = _data + _offset;
+    _offset += n;
+    return p;
+}
+
+unsigned char Reader::peek() const
+{
+    if (_offset >= _size) {
+        throw InvalidArgument("truncated payload");
+    }
+    return static_cast<unsigned char>(_data[_offset]);
+}
+
+std::uint64_t Reader::readBigEndian(std::size_t n)
+{
+    const auto *p = reinterpret_cast<const unsigned char *>(take(n));
+
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::uint64_t Reader::readIntegerBits(bool &negative)
+{
+    const auto tag = static_cast<unsigned char>(*take(1));
+
+    negative = false;
+    if (tag <= 0x7f) {
+        return tag;
+    }
+    if (tag >= 0xe0) {
+        negative = true;
+        return static_cast<std::uint64_t>(static_cast<std::int64_t>(static_cast<std::int8_t>(tag)));
+    }
+
+    switch (tag) {
+    case 0xcc:
+        return readBigEndian(1);
+    case 0xcd:
+        return readBigEndian(2);
+    case 0xce:
+        return readBigEndian(4);
+    case 0xcf:
+        return readBigEndian(8);
+    }
+
+    std::int64_t value;
+    switch (tag) {
+    case 0xd0:
+        value = static_cast<std::int8_t>(readBigEndian(1));
+        break;
+    case 0xd1:
+        value = static_cast<std::int16_t>(readBigEndian(2));
+        break;
+    case 0xd2:
+        value = static_cast<std::int32_t>(readBigEndian(4));
+        break;
+    case 0xd3:
+        value = static_cast<std::int64_t>(readBigEndian(8));
+        break;
+    default:
+        throw msgpack::type_error();
+    }
+
+    // Signed encodings are used for positive values too
+    negative = value < 0;
+    return static_cast<std::uint64_t>(value);
+}
+
+bool Reader::readBool()
+{
+    switch (static_cast<unsigned char>(*take(1))) {
+    case 0xc2:
+        return false;
+    case 0xc3:
+        return true;
+    default:
+        throw msgpack::type_error();
+    }
+}
+
+double Reader::readFloat()
+{
+    switch (peek()) {
+    case 0xca: {
+        ++_offset;
+        const auto bits = static_cast<std::uint32_t>(readBigEndian(4));
+        float f;
+        std::memcpy(&f, &bits, sizeof f);
+        return f;
+    }
+    case 0xcb: {
+        ++_offset;
+        const std::uint64_t bits = readBigEndian(8);
+        double d;
+        std::memcpy(&d, &bits, sizeof d);
+        return d;
+    }
+    }
+
+    // Integers are accepted where floats are expected
+    bool negative;
+    const std::uint64_t bits = readIntegerBits(negative);
+    return negative
+        ? static_cast<double>(static_cast<std::int64_t>(bits))
+        : static_cast<double>(bits);
+}
+
+StringRef Reader::readString()
+{
+    const auto tag = static_cast<unsigned char>(*take(1));
+
+    std::size_t n;
+    if (tag >= 0xa0 && tag <= 0xbf) {
+        n = tag & 0x1f;
+    } else {
+        switch (tag) {
+        case 0xd9:
+        case 0xc4:
+            n = readBigEndian(1);
+            break;
+        case 0xda:
+        case 0xc5:
+            n = readBigEndian(2);
+            break;
+        case 0xdb:
+        case 0xc6:
+            n = readBigEndian(4);
+            break;
+        default:
+            throw msgpack::type_error();
+        }
+    }
+
+    const char *p = take(n);
+    return StringRef(p, n);
+}
+
+StringRef Reader::readExt(std::int8_t &type)
+{
+    const auto tag = static_cast<unsigned char>(*take(1));
+
+    std::size_t n;
+    switch (tag) {
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+        n = std::size_t(1) << (tag - 0xd4);
+        break;
+    case 0xc7:
+        n = readBigEndian(1);
+        break;
+    case 0xc8:
+        n = readBigEndian(2);
+        break;
+    case 0xc9:
+        n = readBigEndian(4);
+        break;
+    default:
+        throw msgpack::type_error();
+    }
+
+    type = static_cast<std::int8_t>(*take(1));
+    const char *p = take(n);
+    return StringRef(p, n);
+}
+
+// Every element takes at least `minBytes`, so a longer length can only come
+// from a malformed payload
+std::uint32_t Reader::checkLength(std::uint64_t n, std::size_t minBytes) const
+{
+    if (n > (_size - _offset) / minBytes) {
+        throw InvalidArgument("truncated payload");
+    }
+    return static_cast<std::uint32_t>(n);
+}
+
+std::uint32_t Reader::readArray()
+{
+    const auto tag = static_cast<unsigned char>(*take(1));
+    if (tag >= 0x90 && tag <= 0x9f) {
+        return checkLength(tag & 0x0f, 1);
+    }
+
+    switch (tag) {
+    case 0xdc:
+        return checkLength(readBigEndian(2), 1);
+    case 0xdd:
+        return checkLength(readBigEndian(4), 1);
+    default:
+        throw msgpack::type_error();
+    }
+}
+
+std::uint32_t Reader::readMap()
+{
+    const auto tag = static_cast<unsigned char>(*take(1));
+    if (tag >= 0x80 && tag <= 0x8f) {
+        return checkLength(tag & 0x0f, 2);
+    }
+
+    switch (tag) {
+    case 0xde:
+        return checkLength(readBigEndian(2), 2);
+    case 0xdf:
+        return checkLength(readBigEndian(4), 2);
+    default:
+        throw msgpack::type_error();
+    }
+}
+
+void Reader::skip()
+{
+    // Values still to skip, counting the elements of containers entered
+    std::uint64_t left = 1;
+    while (left > 0) {
+        --left;
+
+        const auto tag = static_cast<unsigned char>(*take(1));
+        if (tag <= 0x7f || tag >= 0xe0 || (tag >= 0xc0 && tag <= 0xc3)) {
+            continue;
+        }
+        if (tag >= 0x80 && tag <= 0x8f) {
+            left += 2 * (tag & 0x0f);
+            continue;
+        }
+        if (tag >= 0x90 && tag <= 0x9f) {
+            left += tag & 0x0f;
+            continue;
+        }
+        if (tag >= 0xa0 && tag <= 0xbf) {
+            take(tag & 0x1f);
+            continue;
+        }
+
+        switch (tag) {
+        case 0xc4:
+        case 0xd9:
+            take(readBigEndian(1));
+            break;
+        case 0xc5:
+        case 0xda:
+            take(readBigEndian(2));
+            break;
+        case 0xc6:
+        case 0xdb:
+            take(readBigEndian(4));
+            break;
+        case 0xc7:
+            take(readBigEndian(1) + 1);
+            break;
+        case 0xc8:
+            take(readBigEndian(2) + 1);
+            break;
+        case 0xc9:
+            take(readBigEndian(4) + 1);
+            break;
+        case 0xcc:
+        case 0xd0:
+            take(1);
+            break;
+        case 0xcd:
+        case 0xd1:
+            take(2);
+            break;
+        case 0xca:
+        case 0xce:
+        case 0xd2:
+            take(4);
+            break;
+        case 0xcb:
+        case 0xcf:
+        case 0xd3:
+            take(8);
+            break;
+        case 0xd4:
+            take(2);
+            break;
+        case 0xd5:
+            take(3);
+            break;
+        case 0xd6:
+            take(5);
+            break;
+        case 0xd7:
+            take(9);
+            break;
+        case 0xd8:
+            take(17);
+            break;
+        case 0xdc:
+            left += readBigEndian(2);
+            break;
+        case 0xdd:
+            left += readBigEndian(4);
+            break;
+        case 0xde:
+            left += 2 * readBigEndian(2);
+            break;
+        case 0xdf:
+            left += 2 * readBigEndian(4);
+            break;
+        default:
+            throw InvalidArgument("malformed payload");
+        }
+    }
+}
+
+msgpack::object Reader::readObject(msgpack::zone &zone)
+{
+    return msgpack::unpack(zone, _data, _size, _offset);
+}
+
+}
+
+}
@@ -0,0 +1,51 @@
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "ecumene/ecm_key.h"
+
+namespace ecumene {
+
+namespace detail {
+
+struct EcmKeyRegistry {
+    std::mutex mutex;
+    std::unordered_map<std::string, EcmKey> keys;
+
+    // Deque so that references to names stay valid
+    std::deque<std::string> names;
+};
+
+// Functions may be constructed during static initialization
+static EcmKeyRegistry &registry()
+{
+    static EcmKeyRegistry registry;
+    return registry;
+}
+
+EcmKey internEcmKey(const std::string &ecmKey)
+{
+    EcmKeyRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    const auto it = r.keys.find(ecmKey);
+    if (it != r.keys.cend()) {
+        return it->second;
+    }
+
+    const auto key = static_cast<EcmKey>(r.names.size());
+    r.names.push_back(ecmKey);
+    r.keys.insert(std::make_pair(ecmKey, key));
+    return key;
+}
+
+const std::string &ecmKeyName(EcmKey key)
+{
+    EcmKeyRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return r.names.at(key);
+}
+
+}
+
+}
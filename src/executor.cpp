@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ecumene/executor.h"
+
+namespace ecumene {
+
+// Pool and queue the current thread works for, if any
+static thread_local ThreadPoolExecutor *currentPool = nullptr;
+static thread_local std::size_t currentQueue = 0;
+
+void InlineExecutor::execute(Task &&task)
+{
+    task();
+}
+
+PollableExecutor::PollableExecutor()
+    : _signalled(false)
+{
+    const int rc = pipe(_pipe);
+    assert(rc == 0);
+    (void)rc;
+
+    fcntl(_pipe[0], F_SETFL, fcntl(_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(_pipe[1], F_SETFD, FD_CLOEXEC);
+}
+
+PollableExecutor::~PollableExecutor()
+{
+    close(_pipe[0]);
+    close(_pipe[1]);
+}
+
+void PollableExecutor::execute(Task &&task)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(std::move(task));
+    signal();
+}
+
+void PollableExecutor::signal()
+{
+    if (!_signalled) {
+        const char byte = 0;
+        while (write(_pipe[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+        _signalled = true;
+    }
+}
+
+int PollableExecutor::fd() const
+{
+    return _pipe[0];
+}
+
+std::size_t PollableExecutor::drain()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running.swap(_tasks);
+
+        if (_signalled) {
+            char byte;
+            while (read(_pipe[0], &byte, 1) > 0) {
+            }
+            _signalled = false;
+        }
+    }
+
+    // Tasks may queue more, which wait for the next drain
+    const std::size_t count = _running.size();
+    for (auto it = _running.begin(); it != _running.end(); ++it) {
+        try {
+            (*it)();
+        } catch (...) {
+            // Those not run yet go ahead of the ones queued since
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.insert(
+                    _tasks.begin(),
+                    std::make_move_iterator(it + 1),
+                    std::make_move_iterator(_running.end()));
+            _running.clear();
+            if (!_tasks.empty()) {
+                signal();
+            }
+            throw;
+        }
+    }
+    _running.clear();
+
+    return count;
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(std::size_t threads)
+    : _next(0)
+    , _pending(0)
+    , _stopping(false)
+{
+    threads = std::max<std::size_t>(threads, 1);
+
+    for (std::size_t i = 0; i < threads; ++i) {
+        _queues.emplace_back(new Queue());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    // Queued tasks still run before the threads exit
+    for (auto &thread: _threads) {
+        thread.join();
+    }
+}
+
+void ThreadPoolExecutor::execute(Task &&task)
+{
+    const std::size_t index = currentPool == this
+        ? currentQueue
+        : _next++ % _queues.size();
+
+    // Counted before it can be taken, so that the count never drops below
+    // the number of queued tasks
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        ++_pending;
+    }
+    {
+        Queue &queue = *_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    _wakeup.notify_one();
+}
+
+void ThreadPoolExecutor::run(std::size_t index)
+{
+    currentPool = this;
+    currentQueue = index;
+
+    Task task;
+    while (true) {
+        if (pop(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(_sleepMutex);
+                --_pending;
+            }
+            task();
+            task = Task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeup.wait(lock, [this] { return _stopping || _pending > 0; });
+        if (_stopping && _pending == 0) {
+            break;
+        }
+    }
+
+    currentPool = nullptr;
+}
+
+bool ThreadPoolExecutor::pop(std::size_t index, Task &task)
+{
+    {
+        // Newest first from our own queue, while it is still warm
+        Queue &own = *_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Oldest first from everyone else's
+    for (std::size_t i = 1; i < _queues.size(); ++i) {
+        Queue &victim = *_queues[(index + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
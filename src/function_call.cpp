@@ -1,41 +1,121 @@
 #include <czmq.h>
 #include <msgpack.hpp>
 
+#include "ecumene/broadcast.h"
 #include "ecumene/function_call.h"
-
-#define UNUSED(x) (void)(x)
+#include "ecumene/stream.h"
 
 namespace ecumene {
 
 FunctionCall::FunctionCall(
-        const std::string &ecmKey,
+        detail::EcmKey ecmKey,
         const msgpack::sbuffer &sbuf,
-        const std::function<void(const FunctionCallResult &&)> &callback,
-        const std::chrono::seconds &timeout)
+        FunctionCallResultCallback &&callback,
+        const std::chrono::milliseconds &timeout,
+        std::size_t compressionThreshold,
+        detail::MessageHeader header)
     : ecmKey(ecmKey)
-    , args(zmsg_new())
-    , callback(callback)
-    , timeoutAt(std::chrono::steady_clock::now() + timeout)
+    , args(nullptr)
+    , header(nullptr)
+    , compressionThreshold(compressionThreshold)
+    , callback(std::move(callback))
+    , startedAt(std::chrono::steady_clock::now())
+    , timeoutAt(startedAt + timeout)
+    , priority(header.priority)
+    , sent(false)
+    , idempotent(false)
+    , direct(false)
+    , captured(false)
+    , asked(0)
+    , answered(0)
+    , credits(0)
+    , uploaded(false)
+    , partitioned(false)
+    , partition(0)
+    , peer(nullptr)
 {
+    // Blob references are small
+    bool compressed;
+    args = detail::makePayloadFrame(
+            sbuf.data(),
+            sbuf.size(),
+            header.has(detail::MessageHeader::Blobs) ? NoCompression : compressionThreshold,
+            compressed);
     assert(args);
 
-    int rc = zmsg_addmem(args, sbuf.data(), sbuf.size());
-    UNUSED(rc);
-    assert(rc == 0);
+    if (compressionThreshold != NoCompression) {
+        // Let the worker know we can take a compressed result
+        header.set(detail::MessageHeader::AcceptsCompression);
+    }
+    if (compressed) {
+        header.set(detail::MessageHeader::Compressed);
+    }
+
+    if (!header.empty()) {
+        this->header = header.encode();
+        assert(this->header);
+    }
 }
 
-FunctionCall::FunctionCall(FunctionCall &&other)
-    : ecmKey(std::move(other.ecmKey))
+FunctionCall::FunctionCall(FunctionCall &&other) noexcept
+    : ecmKey(other.ecmKey)
     , args(other.args)
+    , header(other.header)
+    , blobs(std::move(other.blobs))
+    , compressionThreshold(other.compressionThreshold)
     , callback(std::move(other.callback))
+    , startedAt(other.startedAt)
     , timeoutAt(other.timeoutAt)
+    , priority(other.priority)
+    , sent(other.sent)
+    , idempotent(other.idempotent)
+    , direct(other.direct)
+    , captured(other.captured)
+    , broadcast(std::move(other.broadcast))
+    , asked(other.asked)
+    , answered(other.answered)
+    , upload(std::move(other.upload))
+    , credits(other.credits)
+    , uploaded(other.uploaded)
+    , partitioned(other.partitioned)
+    , partition(other.partition)
+    , peer(other.peer)
 {
     other.args = nullptr;
+    other.header = nullptr;
 }
 
 FunctionCall::~FunctionCall()
 {
-    zmsg_destroy(&args);
+    zframe_destroy(&args);
+    zframe_destroy(&header);
+}
+
+void FunctionCall::inlineBlobs()
+{
+    detail::Pooled<msgpack::sbuffer> full;
+    detail::inlineBlobs(
+            reinterpret_cast<const char *>(zframe_data(args)),
+            zframe_size(args),
+            blobs,
+            true,
+            *full);
+    blobs.clear();
+
+    // Unlike the references, the blobs may be worth compressing
+    bool compressed;
+    zframe_destroy(&args);
+    args = detail::makePayloadFrame(
+            full->data(), full->size(), compressionThreshold, compressed);
+    assert(args);
+
+    if (compressed) {
+        detail::MessageHeader decoded = detail::MessageHeader::decode(header);
+        decoded.set(detail::MessageHeader::Compressed);
+        zframe_destroy(&header);
+        header = decoded.encode();
+        assert(header);
+    }
 }
 
 }
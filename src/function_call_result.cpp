@@ -1,11 +1,16 @@
 #include <czmq.h>
 
+#include "ecumene/compression.h"
 #include "ecumene/function_call_result.h"
 
 namespace ecumene {
 
-FunctionCallResult::FunctionCallResult(zframe_t **statusPtr, zframe_t **resultPtr)
+FunctionCallResult::FunctionCallResult(
+        zframe_t **statusPtr,
+        zframe_t **resultPtr,
+        const detail::MessageHeader &header)
     : _result(*resultPtr)
+    , _header(header)
 {
     *resultPtr = nullptr;
 
@@ -25,9 +30,10 @@ FunctionCallResult::FunctionCallResult(zframe_t **statusPtr, zframe_t **resultPt
     *statusPtr = nullptr;
 }
 
-FunctionCallResult::FunctionCallResult(FunctionCallResult &&other)
+FunctionCallResult::FunctionCallResult(FunctionCallResult &&other) noexcept
     : _status(other._status)
     , _result(other._result)
+    , _header(other._header)
 {
     other._result = nullptr;
 }
@@ -52,4 +58,18 @@ std::size_t FunctionCallResult::size() const
     return zframe_size(_result);
 }
 
+const detail::MessageHeader &FunctionCallResult::header() const
+{
+    return _header;
+}
+
+msgpack::object FunctionCallResult::unpack(msgpack::zone &zone) const
+{
+    return detail::unpackPayload(
+            data(),
+            size(),
+            _header.has(detail::MessageHeader::Compressed),
+            zone);
+}
+
 }
@@ -40,10 +40,11 @@ HeartbeatService::~HeartbeatService()
 
 void HeartbeatService::registerWorker(
         const std::string &ecmKey,
-        const std::string &endpoint)
+        const std::string &endpoint,
+        const std::shared_ptr<detail::LoadMonitor> &load)
 {
     std::lock_guard<std::mutex> lock(workersMutex);
-    workers.insert(std::make_pair(ecmKey, endpoint));
+    workers.insert(std::make_pair(ecmKey, Worker { endpoint, load }));
 }
 
 void HeartbeatService::unregisterWorker(
@@ -54,7 +55,7 @@ void HeartbeatService::unregisterWorker(
 
     auto range = workers.equal_range(ecmKey);
     for (auto it = range.first; it != range.second; ++it) {
-        if (it->second == endpoint) {
+        if (it->second.endpoint == endpoint) {
             workers.erase(it);
             break;
         }
@@ -63,6 +64,22 @@ void HeartbeatService::unregisterWorker(
     unreg.insert(std::make_pair(ecmKey, endpoint));
 }
 
+void HeartbeatService::setWorkerLoad(
+        const std::string &ecmKey,
+        const std::string &endpoint,
+        const std::shared_ptr<detail::LoadMonitor> &load)
+{
+    std::lock_guard<std::mutex> lock(workersMutex);
+
+    auto range = workers.equal_range(ecmKey);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.endpoint == endpoint) {
+            it->second.load = load;
+            break;
+        }
+    }
+}
+
 inline int sendVersion(zsock_t *sock, bool more = true)
 {
     zframe_t *version =
@@ -139,12 +156,23 @@ void HeartbeatService::actorTask(zsock_t *pipe, void *args)
                 rc = sendVersion(service.ecm);
                 assert(rc == 0);
 
-                rc = zstr_sendx(
-                        service.ecm,
-                        "",
-                        worker.first.c_str(),
-                        worker.second.c_str(),
-                        nullptr);
+                rc = zstr_sendm(service.ecm, "");
+                assert(rc == 0);
+
+                rc = zstr_sendm(service.ecm, worker.first.c_str());
+                assert(rc == 0);
+
+                if (!worker.second.load) {
+                    rc = zstr_send(service.ecm, worker.second.endpoint.c_str());
+                    assert(rc == 0);
+                    continue;
+                }
+
+                rc = zstr_sendm(service.ecm, worker.second.endpoint.c_str());
+                assert(rc == 0);
+
+                zframe_t *load = worker.second.load->report().encode();
+                rc = zframe_send(&load, service.ecm, 0);
                 assert(rc == 0);
             }
 
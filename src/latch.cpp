@@ -0,0 +1,68 @@
+#include "ecumene/latch.h"
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ecumene {
+
+namespace detail {
+
+#ifdef __linux__
+static_assert(sizeof (std::atomic<int>) == sizeof (int), "futex needs a plain int");
+
+static int *futexWord(std::atomic<int> &state)
+{
+    return reinterpret_cast<int *>(&state);
+}
+#endif
+
+void Latch::wait(const std::chrono::microseconds &spin)
+{
+    if (spin.count() > 0) {
+        const auto until = std::chrono::steady_clock::now() + spin;
+        while (_state.load(std::memory_order_acquire) != Open &&
+                std::chrono::steady_clock::now() < until) {
+        }
+    }
+
+#ifdef __linux__
+    while (true) {
+        int state = _state.load(std::memory_order_acquire);
+        if (state == Open) {
+            return;
+        }
+        if (state == Closed &&
+                !_state.compare_exchange_weak(state, Sleeping, std::memory_order_acquire)) {
+            continue;
+        }
+
+        syscall(SYS_futex, futexWord(_state), FUTEX_WAIT_PRIVATE, Sleeping,
+                nullptr, nullptr, 0);
+    }
+#else
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this] { return _state.load() == Open; });
+#endif
+}
+
+void Latch::open()
+{
+#ifdef __linux__
+    if (_state.exchange(Open, std::memory_order_release) == Sleeping) {
+        syscall(SYS_futex, futexWord(_state), FUTEX_WAKE_PRIVATE, INT_MAX,
+                nullptr, nullptr, 0);
+    }
+#else
+    std::lock_guard<std::mutex> lock(_mutex);
+    _state = Open;
+    _cv.notify_one();
+#endif
+}
+
+}
+
+}
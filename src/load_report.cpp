@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <thread>
+
+#include <czmq.h>
+#include <msgpack.hpp>
+
+#include "ecumene/load_report.h"
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Packed as a map like MessageHeader, so fields can be added later
+enum LoadField : std::uint8_t {
+    QueueDepthField = 0,
+    InFlightField = 1,
+    P50Field = 2,
+    P99Field = 3,
+    CpuField = 4
+};
+
+double LoadReport::score() const
+{
+    // A slow tail holds up whoever lands behind it, so it weighs in too
+    const double latency = 0.75 * p50 + 0.25 * p99;
+    return (queueDepth + inFlight + 1.0) * (latency + 1.0) * (1000.0 + cpu) / 1000.0;
+}
+
+zframe_t *LoadReport::encode() const
+{
+    Pooled<msgpack::sbuffer> sbuf;
+    msgpack::packer<msgpack::sbuffer> pk(&*sbuf);
+
+    pk.pack_map(5);
+    pk.pack(static_cast<std::uint8_t>(QueueDepthField));
+    pk.pack(queueDepth);
+    pk.pack(static_cast<std::uint8_t>(InFlightField));
+    pk.pack(inFlight);
+    pk.pack(static_cast<std::uint8_t>(P50Field));
+    pk.pack(p50);
+    pk.pack(static_cast<std::uint8_t>(P99Field));
+    pk.pack(p99);
+    pk.pack(static_cast<std::uint8_t>(CpuField));
+    pk.pack(cpu);
+
+    return zframe_new(sbuf->data(), sbuf->size());
+}
+
+LoadReport LoadReport::decode(zframe_t *frame)
+{
+    LoadReport report;
+
+    Pooled<msgpack::zone> zone;
+    const msgpack::object obj = msgpack::unpack(
+            *zone,
+            reinterpret_cast<const char *>(zframe_data(frame)),
+            zframe_size(frame));
+    if (obj.type != msgpack::type::MAP) {
+        throw msgpack::type_error();
+    }
+
+    for (std::uint32_t i = 0; i < obj.via.map.size; ++i) {
+        const msgpack::object_kv &kv = obj.via.map.ptr[i];
+        switch (kv.key.as<std::uint8_t>()) {
+        case QueueDepthField:
+            report.queueDepth = kv.val.as<std::uint32_t>();
+            break;
+        case InFlightField:
+            report.inFlight = kv.val.as<std::uint32_t>();
+            break;
+        case P50Field:
+            report.p50 = kv.val.as<std::uint32_t>();
+            break;
+        case P99Field:
+            report.p99 = kv.val.as<std::uint32_t>();
+            break;
+        case CpuField:
+            report.cpu = kv.val.as<std::uint16_t>();
+            break;
+        default:
+            break;
+        }
+    }
+
+    return report;
+}
+
+LoadMonitor::LoadMonitor()
+    : _inFlight(0)
+    , _queueDepth(0)
+    , _count(0)
+    , _cpuAt(std::clock())
+    , _reportedAt(std::chrono::steady_clock::now())
+{
+}
+
+void LoadMonitor::accepted(std::size_t waiting)
+{
+    ++_inFlight;
+
+    // Keep the largest backlog seen since the last report
+    const auto depth = static_cast<std::uint32_t>(waiting);
+    std::uint32_t seen = _queueDepth;
+    while (depth > seen && !_queueDepth.compare_exchange_weak(seen, depth)) {
+    }
+}
+
+void LoadMonitor::answered(const std::chrono::steady_clock::duration &latency)
+{
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latencies[_count++ % SAMPLES] = static_cast<std::uint32_t>(us);
+}
+
+void LoadMonitor::released()
+{
+    --_inFlight;
+}
+
+LoadReport LoadMonitor::report()
+{
+    LoadReport report;
+    report.inFlight = _inFlight;
+    report.queueDepth = _queueDepth.exchange(0);
+
+    std::array<std::uint32_t, SAMPLES> latencies;
+    std::size_t n;
+    std::clock_t cpuAt;
+    std::chrono::steady_clock::time_point reportedAt;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        n = std::min(_count, SAMPLES);
+        std::copy(_latencies.cbegin(), _latencies.cbegin() + n, latencies.begin());
+        _count = 0;
+
+        cpuAt = _cpuAt;
+        reportedAt = _reportedAt;
+        _cpuAt = std::clock();
+        _reportedAt = std::chrono::steady_clock::now();
+    }
+
+    if (n > 0) {
+        std::sort(latencies.begin(), latencies.begin() + n);
+        report.p50 = latencies[n / 2];
+        report.p99 = latencies[(n * 99) / 100];
+    }
+
+    // Process CPU time over wall time of all cores
+    const double wall = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - reportedAt).count();
+    const double cpu = static_cast<double>(std::clock() - cpuAt) / CLOCKS_PER_SEC;
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    if (wall > 0) {
+        report.cpu = static_cast<std::uint16_t>(
+                std::min(1000.0, 1000.0 * cpu / (wall * cores)));
+    }
+
+    return report;
+}
+
+}
+
+}
@@ -30,6 +30,12 @@ std::unique_ptr<zpoller_t, PollerDel> makePoller(zpoller_t *p)
                 p, [](zpoller_t *p) { zpoller_destroy(&p); }));
 }
 
+std::unique_ptr<zactor_t, ActorDel> makeActor(zactor_t *a)
+{
+    return std::move(std::unique_ptr<zactor_t, ActorDel>(
+                a, [](zactor_t *a) { zactor_destroy(&a); }));
+}
+
 }
 
 }
@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include <czmq.h>
+#include <msgpack.hpp>
+
+#include "ecumene/message_header.h"
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+namespace detail {
+
+// Header fields are packed as a map of these keys; unknown keys are skipped
+// so that newer peers can add fields without breaking older ones.
+enum HeaderField : std::uint8_t {
+    FlagsField = 0,
+    SchemaField = 1,
+    ChainField = 2,
+    PriorityField = 3,
+    BudgetField = 4
+};
+
+bool MessageHeader::empty() const
+{
+    return flags == 0 && schema == 0 && chain.empty() &&
+        priority == Priority::Normal && budget == 0;
+}
+
+bool MessageHeader::has(Flag flag) const
+{
+    return (flags & flag) != 0;
+}
+
+void MessageHeader::set(Flag flag)
+{
+    flags |= flag;
+}
+
+void MessageHeader::clear(Flag flag)
+{
+    flags &= static_cast<std::uint8_t>(~flag);
+}
+
+zframe_t *MessageHeader::encode() const
+{
+    Pooled<msgpack::sbuffer> sbuf;
+    msgpack::packer<msgpack::sbuffer> pk(&*sbuf);
+
+    pk.pack_map(1 + (schema != 0) + !chain.empty() + (priority != Priority::Normal) +
+            (budget != 0));
+    pk.pack(static_cast<std::uint8_t>(FlagsField));
+    pk.pack(flags);
+    if (schema != 0) {
+        pk.pack(static_cast<std::uint8_t>(SchemaField));
+        pk.pack(schema);
+    }
+    if (!chain.empty()) {
+        pk.pack(static_cast<std::uint8_t>(ChainField));
+        pk.pack(chain);
+    }
+    if (priority != Priority::Normal) {
+        pk.pack(static_cast<std::uint8_t>(PriorityField));
+        pk.pack(static_cast<std::uint8_t>(priority));
+    }
+    if (budget != 0) {
+        pk.pack(static_cast<std::uint8_t>(BudgetField));
+        pk.pack(budget);
+    }
+
+    return zframe_new(sbuf->data(), sbuf->size());
+}
+
+MessageHeader MessageHeader::decode(zframe_t *frame)
+{
+    MessageHeader header;
+
+    Pooled<msgpack::zone> zone;
+    const msgpack::object obj = msgpack::unpack(
+            *zone,
+            reinterpret_cast<const char *>(zframe_data(frame)),
+            zframe_size(frame));
+    if (obj.type != msgpack::type::MAP) {
+        throw msgpack::type_error();
+    }
+
+    for (std::uint32_t i = 0; i < obj.via.map.size; ++i) {
+        const msgpack::object_kv &kv = obj.via.map.ptr[i];
+        switch (kv.key.as<std::uint8_t>()) {
+        case FlagsField:
+            header.flags = kv.val.as<std::uint8_t>();
+            break;
+        case SchemaField:
+            header.schema = kv.val.as<std::uint64_t>();
+            break;
+        case ChainField:
+            header.chain = kv.val.as<std::vector<std::string>>();
+            break;
+        case PriorityField:
+            // Classes added later are served as the lowest known
+            header.priority = static_cast<Priority>(std::min<std::uint8_t>(
+                        kv.val.as<std::uint8_t>(),
+                        static_cast<std::uint8_t>(Priority::Low)));
+            break;
+        case BudgetField:
+            header.budget = kv.val.as<std::uint32_t>();
+            break;
+        default:
+            break;
+        }
+    }
+
+    return header;
+}
+
+}
+
+}
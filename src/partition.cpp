@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cassert>
+
+#include "ecumene/partition.h"
+#include "ecumene/raw_codec.h"
+
+namespace ecumene {
+
+namespace detail {
+
+std::uint64_t partitionHash(const char *data, std::size_t size)
+{
+    std::uint64_t hash = FNV_OFFSET;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Spreads the score of similar seeds and partitions over the whole range
+static std::uint64_t mix(std::uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+void Rendezvous::assign(std::vector<std::string> &&endpoints)
+{
+    // Sorted so that ties are broken the same way everywhere
+    std::sort(endpoints.begin(), endpoints.end());
+    endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+
+    _endpoints = std::move(endpoints);
+    _seeds.clear();
+    for (const auto &endpoint: _endpoints) {
+        _seeds.push_back(partitionHash(endpoint.data(), endpoint.size()));
+    }
+}
+
+bool Rendezvous::empty() const
+{
+    return _endpoints.empty();
+}
+
+bool Rendezvous::contains(const std::string &endpoint) const
+{
+    return std::binary_search(_endpoints.begin(), _endpoints.end(), endpoint);
+}
+
+const std::string &Rendezvous::pick(std::uint64_t partition) const
+{
+    assert(!_endpoints.empty());
+
+    std::size_t best = 0;
+    std::uint64_t bestScore = 0;
+    for (std::size_t i = 0; i < _seeds.size(); ++i) {
+        const std::uint64_t score = mix(_seeds[i] ^ mix(partition));
+        if (i == 0 || score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return _endpoints[best];
+}
+
+}
+
+}
@@ -0,0 +1,75 @@
+#include <cstddef>
+#include <vector>
+
+#include "ecumene/pool.h"
+
+namespace ecumene {
+
+namespace detail {
+
+static const std::size_t MAX_POOLED = 16;
+static const std::size_t MAX_RETAINED_SIZE = 1 << 20;
+
+static thread_local std::vector<std::unique_ptr<msgpack::sbuffer>> buffers;
+static thread_local std::vector<std::unique_ptr<msgpack::zone>> zones;
+
+template<class T>
+static std::unique_ptr<T> pop(std::vector<std::unique_ptr<T>> &pool)
+{
+    if (pool.empty()) {
+        return std::unique_ptr<T>(new T());
+    }
+
+    auto object = std::move(pool.back());
+    pool.pop_back();
+    return object;
+}
+
+template<class T>
+static void push(std::vector<std::unique_ptr<T>> &pool, std::unique_ptr<T> &&object)
+{
+    if (object && pool.size() < MAX_POOLED) {
+        pool.push_back(std::move(object));
+    }
+}
+
+template<>
+std::unique_ptr<msgpack::sbuffer> acquire<msgpack::sbuffer>()
+{
+    return pop(buffers);
+}
+
+template<>
+void release<msgpack::sbuffer>(std::unique_ptr<msgpack::sbuffer> &&object)
+{
+    // The buffer's capacity is at least its size, so a large size means a
+    // large allocation we'd rather give back
+    if (!object || object->size() > MAX_RETAINED_SIZE) {
+        return;
+    }
+
+    object->clear();
+    push(buffers, std::move(object));
+}
+
+template<>
+std::unique_ptr<msgpack::zone> acquire<msgpack::zone>()
+{
+    return pop(zones);
+}
+
+template<>
+void release<msgpack::zone>(std::unique_ptr<msgpack::zone> &&object)
+{
+    if (!object) {
+        return;
+    }
+
+    // Keeps only the initial chunk
+    object->clear();
+    push(zones, std::move(object));
+}
+
+}
+
+}
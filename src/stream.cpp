@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <czmq.h>
+
+#include "ecumene/stream.h"
+
+namespace ecumene {
+
+namespace detail {
+
+static thread_local std::shared_ptr<StreamState> currentStream;
+
+// Chunks from a user function
+class GeneratorSource: public UploadSource {
+public:
+    explicit GeneratorSource(std::function<bool(std::string &)> &&next)
+        : _next(std::move(next))
+    {
+    }
+
+    zframe_t *next() override
+    {
+        _chunk.clear();
+        if (!_next(_chunk)) {
+            return nullptr;
+        }
+        return zframe_new(_chunk.data(), _chunk.size());
+    }
+
+private:
+    std::function<bool(std::string &)> _next;
+    std::string _chunk;
+};
+
+// Slices of a mapped file. Pages already sent are dropped from the mapping,
+// so the upload doesn't stay resident.
+class FileSource: public UploadSource {
+public:
+    FileSource(const std::string &path, std::size_t chunkSize)
+        : _data(nullptr)
+        , _size(0)
+        , _offset(0)
+        , _released(0)
+        , _chunkSize(std::max<std::size_t>(chunkSize, 1))
+    {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        _size = static_cast<std::size_t>(st.st_size);
+
+        if (_size > 0) {
+            void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            _data = static_cast<char *>(p);
+            madvise(_data, _size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    ~FileSource()
+    {
+        if (_data) {
+            munmap(_data, _size);
+        }
+    }
+
+    zframe_t *next() override
+    {
+        if (_offset >= _size) {
+            return nullptr;
+        }
+
+        const std::size_t n = std::min(_chunkSize, _size - _offset);
+        zframe_t *chunk = zframe_new(_data + _offset, n);
+        _offset += n;
+
+        // Whole pages behind us are copied out already
+        static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        const std::size_t done = _offset / pageSize * pageSize;
+        if (done > _released) {
+            madvise(_data + _released, done - _released, MADV_DONTNEED);
+            _released = done;
+        }
+
+        return chunk;
+    }
+
+private:
+    char *_data;
+    std::size_t _size;
+    std::size_t _offset;
+    std::size_t _released;
+    const std::size_t _chunkSize;
+};
+
+StreamState::StreamState(std::function<void(std::size_t)> &&grant)
+    : _grant(std::move(grant))
+    , _lastActive(std::chrono::steady_clock::now())
+{
+}
+
+StreamState::~StreamState()
+{
+    for (zframe_t *chunk: _buffered) {
+        zframe_destroy(&chunk);
+    }
+}
+
+void StreamState::push(zframe_t *chunk)
+{
+    _lastActive = std::chrono::steady_clock::now();
+    _buffered.push_back(chunk);
+    deliver();
+}
+
+void StreamState::finish()
+{
+    _lastActive = std::chrono::steady_clock::now();
+    _finished = true;
+    deliver();
+}
+
+void StreamState::fail(const std::exception_ptr &eptr)
+{
+    if (_finished || _eptr) {
+        return;
+    }
+    _eptr = eptr;
+
+    for (zframe_t *chunk: _buffered) {
+        zframe_destroy(&chunk);
+    }
+    _buffered.clear();
+
+    deliver();
+}
+
+void StreamState::read(Chunk &&chunk, End &&end, Error &&error)
+{
+    if (_chunk) {
+        throw InvalidArgument("stream is already being read");
+    }
+
+    _chunk = std::move(chunk);
+    _end = std::move(end);
+    _error = std::move(error);
+    deliver();
+}
+
+std::chrono::steady_clock::time_point StreamState::lastActive() const
+{
+    return _lastActive;
+}
+
+void StreamState::deliver()
+{
+    // Reentered if a callback makes the stream progress
+    if (!_chunk || _reading) {
+        return;
+    }
+    _reading = true;
+
+    std::size_t consumed = 0;
+    while (!_buffered.empty()) {
+        zframe_t *chunk = _buffered.front();
+        _buffered.pop_front();
+
+        _chunk(reinterpret_cast<const char *>(zframe_data(chunk)), zframe_size(chunk));
+        zframe_destroy(&chunk);
+        ++consumed;
+    }
+
+    if (consumed > 0 && !_finished) {
+        _grant(consumed);
+    }
+
+    _reading = false;
+
+    if (_eptr && _error) {
+        const Error error = std::move(_error);
+        _error = nullptr;
+        _end = nullptr;
+        error(_eptr);
+    } else if (_finished && _end) {
+        const End end = std::move(_end);
+        _end = nullptr;
+        end();
+    }
+}
+
+void setCurrentStream(const std::shared_ptr<StreamState> &state)
+{
+    currentStream = state;
+}
+
+std::shared_ptr<StreamState> takeCurrentStream()
+{
+    return std::move(currentStream);
+}
+
+std::shared_ptr<StreamState> streamFrom(std::int8_t type, std::size_t size)
+{
+    if (type != STREAM_EXT || size != 0) {
+        throw msgpack::type_error();
+    }
+
+    auto state = takeCurrentStream();
+    if (!state) {
+        throw InvalidArgument("streamed argument without a stream");
+    }
+    return state;
+}
+
+}
+
+Upload::Upload(std::function<bool(std::string &chunk)> &&next)
+    : _source(std::make_shared<detail::GeneratorSource>(std::move(next)))
+{
+}
+
+Upload::Upload(const std::shared_ptr<detail::UploadSource> &source)
+    : _source(source)
+{
+}
+
+Upload Upload::fromFile(const std::string &path, std::size_t chunkSize)
+{
+    return Upload(std::make_shared<detail::FileSource>(path, chunkSize));
+}
+
+std::shared_ptr<detail::UploadSource> uploadSource(const Upload &upload)
+{
+    return upload._source;
+}
+
+void ChunkStream::read(
+        std::function<void(const char *data, std::size_t size)> &&chunk,
+        std::function<void()> &&end,
+        std::function<void(const std::exception_ptr &)> &&error) const
+{
+    if (!_state) {
+        throw InvalidArgument("stream is not readable");
+    }
+    _state->read(std::move(chunk), std::move(end), std::move(error));
+}
+
+}
@@ -1,34 +1,352 @@
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <czmq.h>
 
+#include "ecumene/blob.h"
+#include "ecumene/client_agent.h"
+#include "ecumene/compression.h"
 #include "ecumene/exception.h"
 #include "ecumene/memory.h"
+#include "ecumene/message_header.h"
+#include "ecumene/pool.h"
+#include "ecumene/priority.h"
+#include "ecumene/stream.h"
 #include "ecumene/worker_agent.h"
 
 #define UNUSED(x) (void)(x)
 
 namespace ecumene {
 
+namespace detail {
+
+// Where replies go. Replies made on the actor thread are sent on the ROUTER
+// directly; others are handed to the actor through its pipe.
+struct WorkerOutbox {
+    std::mutex mutex;
+
+    // Null once the agent is gone
+    zactor_t *actor = nullptr;
+
+    std::atomic<std::size_t> compressionThreshold{NoCompression};
+
+    const std::shared_ptr<LoadMonitor> load = std::make_shared<LoadMonitor>();
+};
+
+// How long a worker waits for the rest of a chain when the caller didn't
+// say how long it waits itself
+static const std::chrono::seconds CHAIN_TIMEOUT(15);
+
+// Requests read ahead of the one being served, so that they can be served
+// by priority. Beyond that they wait in the socket.
+static const std::size_t MAX_QUEUED = 1024;
+
+// Outbox served by the current thread, if it is a worker actor
+static thread_local WorkerOutbox *currentOutbox = nullptr;
+static thread_local zsock_t *currentRouter = nullptr;
+
+struct PendingReply {
+    const std::shared_ptr<WorkerOutbox> outbox;
+    zframe_t *identity;
+    zframe_t *id;
+    bool acceptsCompression = false;
+    bool oneWay = false;
+    Priority priority = Priority::Normal;
+
+    // Where the result goes instead of back to the caller
+    std::vector<std::string> chain;
+
+    const std::chrono::steady_clock::time_point receivedAt =
+        std::chrono::steady_clock::now();
+
+    // When the caller stops waiting for the rest of the chain
+    std::chrono::steady_clock::time_point deadline = receivedAt + CHAIN_TIMEOUT;
+
+    // Set up front for one-way requests, which are never answered
+    std::atomic<bool> sent{false};
+
+    PendingReply(
+            const std::shared_ptr<WorkerOutbox> &outbox,
+            zframe_t *identity,
+            zframe_t *id)
+        : outbox(outbox)
+        , identity(identity)
+        , id(id)
+    {
+    }
+
+    ~PendingReply()
+    {
+        if (!sent) {
+            send("?", zframe_new_empty(), MessageHeader());
+        }
+        zframe_destroy(&identity);
+        zframe_destroy(&id);
+
+        outbox->load->released();
+    }
+
+    void send(const char *status, zframe_t *data, const MessageHeader &header)
+    {
+        if (sent.exchange(true)) {
+            zframe_destroy(&data);
+            return;
+        }
+
+        outbox->load->answered(std::chrono::steady_clock::now() - receivedAt);
+
+        zmsg_t *response = zmsg_new();
+
+        // Identity for ROUTER
+        zmsg_append(response, &identity);
+
+        // Caller local ID
+        zmsg_append(response, &id);
+
+        // Status
+        zframe_t *f = zframe_new(status, std::strlen(status));
+        zmsg_append(response, &f);
+
+        // Result
+        zmsg_append(response, &data);
+
+        // Header, only understood by newer clients
+        if (!header.empty()) {
+            f = header.encode();
+            zmsg_append(response, &f);
+        }
+
+        transmit(response);
+    }
+
+    // Lets the client send `n` more upload chunks
+    void credit(std::size_t n)
+    {
+        if (sent) {
+            return;
+        }
+
+        zmsg_t *msg = zmsg_new();
+        zframe_t *f = zframe_dup(identity);
+        zmsg_append(msg, &f);
+        f = zframe_dup(id);
+        zmsg_append(msg, &f);
+        zmsg_addstr(msg, "C");
+
+        // Little-endian count
+        char count[4];
+        for (std::size_t i = 0; i < sizeof count; ++i) {
+            count[i] = static_cast<char>((n >> (8 * i)) & 0xff);
+        }
+        zmsg_addmem(msg, count, sizeof count);
+
+        transmit(msg);
+    }
+
+private:
+    void transmit(zmsg_t *msg)
+    {
+        if (currentOutbox == outbox.get()) {
+            zmsg_send(&msg, currentRouter);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(outbox->mutex);
+        if (outbox->actor) {
+            zmsg_pushstr(msg, "$REPLY");
+            zmsg_send(&msg, outbox->actor);
+        } else {
+            zmsg_destroy(&msg);
+        }
+    }
+};
+
+// A request waiting to be served
+struct QueuedRequest {
+    std::shared_ptr<PendingReply> pending;
+    decltype(makeFrame(nullptr)) args;
+    MessageHeader header;
+
+    // Chunks of a streamed request
+    std::shared_ptr<StreamState> stream;
+};
+
+// Streams that haven't seen a chunk for this long are dropped
+static const std::chrono::seconds STREAM_IDLE_TIMEOUT(60);
+
+// Identifies a streamed request among those of every client
+static std::string streamKey(zframe_t *identity, zframe_t *id)
+{
+    std::string key(reinterpret_cast<const char *>(zframe_data(identity)), zframe_size(identity));
+    key.push_back('\0');
+    key.append(reinterpret_cast<const char *>(zframe_data(id)), zframe_size(id));
+    return key;
+}
+
+static const char *statusText(FunctionCallResult::Status status)
+{
+    switch (status) {
+    case FunctionCallResult::Status::Success:
+        return "";
+    case FunctionCallResult::Status::InvalidArgument:
+        return "I";
+    case FunctionCallResult::Status::UndefinedReference:
+        return "U";
+    case FunctionCallResult::Status::NetworkError:
+        return "N";
+    default:
+        return "?";
+    }
+}
+
+static const char *statusFor(const std::exception_ptr &eptr)
+{
+    try {
+        std::rethrow_exception(eptr);
+    } catch (const BlobMissing &e) {
+        return "B";
+    } catch (const msgpack::type_error &e) {
+        return "I";
+    } catch (const InvalidArgument &e) {
+        return "I";
+    } catch (const UndefinedReference &e) {
+        return "U";
+    } catch (const NetworkError &e) {
+        return "N";
+    } catch (...) {
+        return "?";
+    }
+}
+
+}
+
+WorkerReply::WorkerReply(const std::shared_ptr<detail::PendingReply> &pending)
+    : _pending(pending)
+{
+}
+
+void WorkerReply::succeed(
+        const msgpack::sbuffer &sbuf,
+        detail::MessageHeader header) const
+{
+    if (!_pending->chain.empty()) {
+        forward(sbuf);
+        return;
+    }
+
+    // Only compress for clients that asked for it
+    const std::size_t threshold = _pending->acceptsCompression
+        ? _pending->outbox->compressionThreshold.load()
+        : NoCompression;
+
+    bool compressed;
+    zframe_t *resultFrame = detail::makePayloadFrame(
+            sbuf.data(), sbuf.size(), threshold, compressed);
+
+    if (compressed) {
+        header.set(detail::MessageHeader::Compressed);
+    }
+
+    _pending->send("", resultFrame, header);
+}
+
+void WorkerReply::forward(const msgpack::sbuffer &sbuf) const
+{
+    const auto &chain = _pending->chain;
+
+    // Later stages get whatever time the caller has left
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            _pending->deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+        fail(std::make_exception_ptr(NetworkError("chain deadline passed")));
+        return;
+    }
+
+    // The next function takes our result as its only argument
+    detail::Pooled<msgpack::sbuffer> args;
+    msgpack::packer<msgpack::sbuffer>(*args).pack_array(1);
+    args->write(sbuf.data(), sbuf.size());
+
+    detail::MessageHeader header;
+    header.chain.assign(chain.cbegin() + 1, chain.cend());
+    header.priority = _pending->priority;
+    header.budget = static_cast<std::uint32_t>(remaining.count());
+
+    // Its answer is relayed back along the chain as is
+    FunctionCallResultCallback callback;
+    if (_pending->oneWay) {
+        header.set(detail::MessageHeader::OneWay);
+    } else {
+        const auto pending = _pending;
+        callback = [pending](const FunctionCallResult &&result) {
+            zframe_t *data = zframe_new(result.data(), result.size());
+            pending->send(detail::statusText(result.status()), data, result.header());
+        };
+    }
+
+    ClientAgent::sharedInstance().send(FunctionCall(
+                detail::internEcmKey(chain.front()),
+                *args,
+                std::move(callback),
+                remaining,
+                NoCompression,
+                header));
+}
+
+void WorkerReply::fail(const std::exception_ptr &eptr) const
+{
+    _pending->send(
+            detail::statusFor(eptr),
+            zframe_new_empty(),
+            detail::MessageHeader());
+}
+
 WorkerAgent::WorkerAgent(
         const std::string &ecmKey,
         const std::string &localEndpoint,
         const std::string &publicEndpoint,
-        const std::function<void(const msgpack::unpacked &, msgpack::sbuffer &)> callback)
+        const WorkerCallback callback,
+        const WorkerTick tick)
     : _ecmKey(ecmKey)
     , _localEndpoint(localEndpoint)
     , _publicEndpoint(publicEndpoint)
     , _callback(callback)
+    , _tick(tick)
+    , _outbox(std::make_shared<detail::WorkerOutbox>())
     , _actor(zactor_new(actorTask, this))
 {
     assert(_actor);
+
+    std::lock_guard<std::mutex> lock(_outbox->mutex);
+    _outbox->actor = _actor;
 }
 
 WorkerAgent::~WorkerAgent()
 {
+    {
+        // Late replies are dropped from now on
+        std::lock_guard<std::mutex> lock(_outbox->mutex);
+        _outbox->actor = nullptr;
+    }
+
     zactor_destroy(&_actor);
 }
 
+void WorkerAgent::setCompressionThreshold(std::size_t threshold)
+{
+    _outbox->compressionThreshold = threshold;
+}
+
+std::shared_ptr<detail::LoadMonitor> WorkerAgent::load() const
+{
+    return _outbox->load;
+}
+
 void WorkerAgent::actorTask(zsock_t *pipe, void *args)
 {
     assert(pipe);
@@ -42,83 +360,193 @@ void WorkerAgent::actorTask(zsock_t *pipe, void *args)
     const auto poller = detail::makePoller(zpoller_new(pipe, worker.get(), nullptr));
     assert(poller.get());
 
+    detail::currentOutbox = agent._outbox.get();
+    detail::currentRouter = worker.get();
+
     int rc = zsock_signal(pipe, 0);
     UNUSED(rc);
     assert(rc == 0);
 
-    bool terminated = false;
-    while (!terminated && !zsys_interrupted) {
-        zsock_t *sock = static_cast<zsock_t *>(zpoller_wait(poller.get(), -1));
+    detail::PriorityQueue<detail::QueuedRequest> queued;
 
-        if (sock == pipe) {
-            std::unique_ptr<char> command(zstr_recv(sock));
-            if (streq(command.get(), "$TERM")) {
-                terminated = true;
+    // Streamed requests still receiving chunks, by client and request id
+    std::unordered_map<std::string, std::shared_ptr<detail::StreamState>> streams;
+    auto nextStreamSweep = std::chrono::steady_clock::now();
+
+    // Reads a request off the socket and queues it by priority
+    const auto accept = [&]() {
+        auto request = detail::makeMsg(zmsg_recv(worker.get()));
+        assert(zmsg_size(request.get()) >= 3);
+
+        zframe_t *identity = zmsg_pop(request.get());
+        zframe_t *id = zmsg_pop(request.get());
+        auto argsFrame = detail::makeFrame(zmsg_pop(request.get()));
+
+        detail::MessageHeader requestHeader;
+        std::exception_ptr eptr;
+        try {
+            if (zmsg_size(request.get()) > 0) {
+                auto headerFrame = detail::makeFrame(zmsg_pop(request.get()));
+                requestHeader = detail::MessageHeader::decode(headerFrame.get());
             }
-        } else if (sock == worker.get()) {
-            auto request = detail::makeMsg(zmsg_recv(sock));
-            assert(zmsg_size(request.get()) == 3);
+        } catch (...) {
+            eptr = std::current_exception();
+        }
+
+        // Chunks go straight to their stream and are never answered
+        if (!eptr && requestHeader.has(detail::MessageHeader::Chunk)) {
+            const std::string key = detail::streamKey(identity, id);
+            zframe_destroy(&identity);
+            zframe_destroy(&id);
+
+            const auto found = streams.find(key);
+            if (found == streams.end()) {
+                return;
+            }
+
+            if (!requestHeader.has(detail::MessageHeader::StreamEnd)) {
+                found->second->push(argsFrame.release());
+            } else if (zframe_size(argsFrame.get()) == 0) {
+                const auto stream = found->second;
+                streams.erase(found);
+                stream->finish();
+            } else {
+                const auto stream = found->second;
+                streams.erase(found);
+                stream->fail(std::make_exception_ptr(
+                            NetworkError("upload aborted by the client")));
+            }
+            return;
+        }
+
+        auto pending =
+            std::make_shared<detail::PendingReply>(agent._outbox, identity, id);
+
+        agent._outbox->load->accepted(queued.size());
+
+        if (eptr) {
+            WorkerReply(pending).fail(eptr);
+            return;
+        }
+
+        pending->acceptsCompression =
+            requestHeader.has(detail::MessageHeader::AcceptsCompression);
+        pending->oneWay = requestHeader.has(detail::MessageHeader::OneWay);
+        pending->sent = pending->oneWay;
+        pending->chain = std::move(requestHeader.chain);
+        if (requestHeader.budget != 0) {
+            pending->deadline =
+                pending->receivedAt + std::chrono::milliseconds(requestHeader.budget);
+        }
+        pending->priority = requestHeader.priority;
+
+        std::shared_ptr<detail::StreamState> stream;
+        if (requestHeader.has(detail::MessageHeader::Streamed)) {
+            const std::weak_ptr<detail::PendingReply> weak = pending;
+            stream = std::make_shared<detail::StreamState>([weak](std::size_t n) {
+                if (const auto p = weak.lock()) {
+                    p->credit(n);
+                }
+            });
+            streams[detail::streamKey(identity, id)] = stream;
+        }
+
+        const Priority priority = requestHeader.priority;
+        queued.push(detail::QueuedRequest {
+                std::move(pending),
+                std::move(argsFrame),
+                std::move(requestHeader),
+                std::move(stream) }, priority);
+    };
+
+    // Fails streams whose client went quiet
+    const auto sweepStreams = [&]() {
+        const auto now = std::chrono::steady_clock::now();
+        if (streams.empty() || now < nextStreamSweep) {
+            return;
+        }
+        nextStreamSweep = now + std::chrono::seconds(1);
 
-            auto identity = detail::makeFrame(zmsg_pop(request.get()));
-            auto id = detail::makeFrame(zmsg_pop(request.get()));
+        for (auto it = streams.begin(); it != streams.end();) {
+            if (now - it->second->lastActive() > detail::STREAM_IDLE_TIMEOUT) {
+                const auto stream = it->second;
+                it = streams.erase(it);
+                stream->fail(std::make_exception_ptr(
+                            NetworkError("upload stopped arriving")));
+            } else {
+                ++it;
+            }
+        }
+    };
 
-            static const auto respond = [](
-                    auto &&identity,
-                    auto &&id,
-                    const char *status,
-                    auto &&data,
-                    zsock_t *sock) {
-                zmsg_t *response = zmsg_new();
+    int timeout = -1;
 
-                // Identity for ROUTER
-                zframe_t *f = identity.release();
-                zmsg_append(response, &f);
+    // Wake at least once a second while streams may go idle
+    const auto pollTimeout = [&]() {
+        if (!queued.empty()) {
+            return 0;
+        }
+        if (!streams.empty() && (timeout < 0 || timeout > 1000)) {
+            return 1000;
+        }
+        return timeout;
+    };
 
-                // Caller local ID
-                f = id.release();
-                zmsg_append(response, &f);
+    bool terminated = false;
+    while (!terminated && !zsys_interrupted) {
+        zsock_t *sock = static_cast<zsock_t *>(
+                zpoller_wait(poller.get(), pollTimeout()));
 
-                // Status
-                f = zframe_new(status, std::strlen(status));
-                zmsg_append(response, &f);
+        if (sock == pipe) {
+            auto msg = detail::makeMsg(zmsg_recv(sock));
+            assert(msg.get());
 
-                // Result
-                f = data.release();
-                zmsg_append(response, &f);
+            std::unique_ptr<char> command(zmsg_popstr(msg.get()));
+            if (streq(command.get(), "$TERM")) {
+                terminated = true;
+            } else if (streq(command.get(), "$REPLY")) {
+                // Completed asynchronously on another thread
+                zmsg_t *response = msg.release();
+                zmsg_send(&response, worker.get());
+            }
+        } else if (sock == worker.get()) {
+            // Take in whatever has arrived
+            do {
+                accept();
+            } while (queued.size() < detail::MAX_QUEUED &&
+                    (zsock_events(worker.get()) & ZMQ_POLLIN));
+        }
 
-                zmsg_send(&response, sock);
-            };
+        // Serve one request at a time, checking for new arrivals in between
+        if (!terminated && !queued.empty()) {
+            detail::QueuedRequest request = queued.pop();
+            const WorkerReply reply(request.pending);
 
+            // The handler's ChunkStream argument picks it up while decoding
+            detail::setCurrentStream(request.stream);
             try {
-                auto argsFrame = detail::makeFrame(zmsg_pop(request.get()));
-
-                msgpack::unpacked msg;
-                msgpack::unpack(
-                        &msg,
-                        reinterpret_cast<const char *>(zframe_data(argsFrame.get())),
-                        zframe_size(argsFrame.get()));
-
-                msgpack::sbuffer sbuf;
-                agent._callback(msg, sbuf);
-
-                auto resultFrame =
-                    detail::makeFrame(zframe_new(sbuf.data(), sbuf.size()));
-
-                respond(identity, id, "", resultFrame, sock);
-            } catch (const msgpack::type_error &e) {
-                respond(identity, id, "I", detail::makeFrame(zframe_new_empty()), sock);
-            } catch (const InvalidArgument &e) {
-                respond(identity, id, "I", detail::makeFrame(zframe_new_empty()), sock);
-            } catch (const UndefinedReference &e) {
-                respond(identity, id, "U", detail::makeFrame(zframe_new_empty()), sock);
-            } catch (const NetworkError &e) {
-                respond(identity, id, "N", detail::makeFrame(zframe_new_empty()), sock);
+                agent._callback(
+                        reinterpret_cast<const char *>(zframe_data(request.args.get())),
+                        zframe_size(request.args.get()),
+                        request.header,
+                        reply);
             } catch (...) {
-                respond(identity, id, "?", detail::makeFrame(zframe_new_empty()), sock);
+                reply.fail(std::current_exception());
             }
+            detail::setCurrentStream(nullptr);
         }
+
+        if (agent._tick) {
+            const auto wait = agent._tick();
+            timeout = wait.count() < 0 ? -1 : static_cast<int>(wait.count());
+        }
+
+        sweepStreams();
     }
 
+    detail::currentOutbox = nullptr;
+    detail::currentRouter = nullptr;
+
     zsys_debug("Cleaned up worker agent.");
 }
 
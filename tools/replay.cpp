@@ -0,0 +1,220 @@
+// Replays a capture file made with ClientAgent::setCapture against the
+// workers currently registered for its keys, and reports latency and
+// throughput next to what was captured.
+//
+//     replay <capture> [--speed <factor> | --max <window>] [--key <ecmKey>]
+//            [--timeout <seconds>]
+//
+// Calls are sent at their captured pace by default, `--speed 2` replays
+// twice as fast, and `--max` sends as fast as the workers keep up with at
+// most `window` calls in flight.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <czmq.h>
+#include <msgpack.hpp>
+
+#include "ecumene/capture.h"
+#include "ecumene/client_agent.h"
+#include "ecumene/ecm_key.h"
+#include "ecumene/message_header.h"
+
+using namespace ecumene;
+
+namespace {
+
+struct Options {
+    std::string path;
+    double speed = 1;
+    std::size_t window = 0;
+    std::string key;
+    std::chrono::seconds timeout{15};
+};
+
+struct Stats {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t inFlight = 0;
+    std::vector<double> latencies;
+    std::map<int, std::size_t> statuses;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+            "usage: replay <capture> [--speed <factor> | --max <window>] "
+            "[--key <ecmKey>] [--timeout <seconds>]\n");
+    std::exit(2);
+}
+
+Options parse(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--speed") == 0 && hasValue) {
+            options.speed = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max") == 0 && hasValue) {
+            options.window = static_cast<std::size_t>(std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "--key") == 0 && hasValue) {
+            options.key = argv[++i];
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && hasValue) {
+            options.timeout = std::chrono::seconds(std::atol(argv[++i]));
+        } else if (argv[i][0] != '-' && options.path.empty()) {
+            options.path = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    if (options.path.empty() || options.speed <= 0) {
+        usage();
+    }
+    return options;
+}
+
+double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+
+    const auto n = static_cast<std::size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+const char *statusName(int status)
+{
+    switch (status) {
+    case FunctionCallResult::Status::Success:
+        return "success";
+    case FunctionCallResult::Status::InvalidArgument:
+        return "invalid argument";
+    case FunctionCallResult::Status::UndefinedReference:
+        return "undefined reference";
+    case FunctionCallResult::Status::NetworkError:
+        return "network error";
+    default:
+        return "unknown error";
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const Options options = parse(argc, argv);
+
+    detail::CaptureReader reader(options.path);
+    std::vector<detail::CaptureEntry> entries;
+    detail::CaptureEntry entry;
+    while (reader.next(entry)) {
+        if (options.key.empty() || entry.ecmKey.str() == options.key) {
+            entries.push_back(entry);
+        }
+    }
+    if (entries.empty()) {
+        std::fprintf(stderr, "No calls to replay.\n");
+        return 1;
+    }
+
+    // Records are in completion order
+    std::stable_sort(entries.begin(), entries.end(),
+            [](const detail::CaptureEntry &a, const detail::CaptureEntry &b) {
+                return a.startedAt < b.startedAt;
+            });
+
+    Stats stats;
+    stats.latencies.reserve(entries.size());
+
+    std::vector<double> captured;
+    captured.reserve(entries.size());
+
+    ClientAgent &agent = ClientAgent::sharedInstance();
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (const auto &e: entries) {
+        captured.push_back(std::chrono::duration<double, std::micro>(e.latency).count());
+
+        if (options.window > 0) {
+            std::unique_lock<std::mutex> lock(stats.mutex);
+            stats.cv.wait(lock, [&] { return stats.inFlight < options.window; });
+        } else {
+            const auto offset = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    (e.startedAt - entries.front().startedAt) / options.speed);
+            std::this_thread::sleep_until(begin + offset);
+        }
+
+        detail::MessageHeader header;
+        if (!e.header.empty()) {
+            zframe_t *frame = zframe_new(e.header.data(), e.header.size());
+            header = detail::MessageHeader::decode(frame);
+            zframe_destroy(&frame);
+        }
+
+        // Arguments go out exactly as captured, compressed or not
+        msgpack::sbuffer sbuf(e.args.size());
+        sbuf.write(e.args.data(), e.args.size());
+
+        const auto sentAt = std::chrono::steady_clock::now();
+        FunctionCall call(
+                detail::internEcmKey(e.ecmKey.str()),
+                sbuf,
+                [&stats, sentAt](const FunctionCallResult &&result) {
+                    const double latency = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - sentAt).count();
+
+                    std::lock_guard<std::mutex> lock(stats.mutex);
+                    stats.latencies.push_back(latency);
+                    ++stats.statuses[result.status()];
+                    --stats.inFlight;
+                    stats.cv.notify_all();
+                },
+                options.timeout,
+                NoCompression,
+                header);
+        call.direct = true;
+
+        {
+            std::lock_guard<std::mutex> lock(stats.mutex);
+            ++stats.inFlight;
+        }
+        agent.send(std::move(call));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(stats.mutex);
+        stats.cv.wait(lock, [&] { return stats.inFlight == 0; });
+    }
+
+    const double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    const double span = std::chrono::duration<double>(
+            entries.back().startedAt - entries.front().startedAt).count();
+
+    std::printf("calls       %zu in %.3f s (captured over %.3f s)\n",
+            entries.size(), elapsed, span);
+    std::printf("throughput  %.1f calls/s\n", entries.size() / elapsed);
+    for (const auto &status: stats.statuses) {
+        std::printf("%-11s %zu\n", statusName(status.first), status.second);
+    }
+    std::printf("latency us  %10s %10s\n", "replayed", "captured");
+    for (const double p: { 0.5, 0.9, 0.99, 1.0 }) {
+        std::printf("  p%-8g %10.1f %10.1f\n",
+                p * 100, percentile(stats.latencies, p), percentile(captured, p));
+    }
+
+    return 0;
+}